@@ -0,0 +1,224 @@
+/**
+ * @file alerts.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the alerts for vehicles parked longer than a
+ * threshold. Every entry arms a timer for the minute its vehicle
+ * overstays, and its exit cancels it, both in constant time. The
+ * timers wait in a hierarchical timing wheel: each level has 64
+ * slots, each 64 times wider than those of the level below, and a
+ * slot is moved to the level below once the clock reaches it, so
+ * every timer is moved at most once per level before it fires.
+ * Stretches of time with no timers due are skipped at once.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/**
+ * Creates a new timing wheel, with alerts off.
+*/
+timing_wheel_t* init_alerts() {
+    timing_wheel_t* wheel = (timing_wheel_t*)safe_malloc(
+     sizeof(timing_wheel_t));
+    memset(wheel, 0, sizeof(timing_wheel_t));
+    return wheel;
+}
+
+/**
+ * Puts a timer in the slot of its deadline, in the lowest level
+ * whose slots reach that far ahead of the clock, or among the
+ * overstaying vehicles if its deadline already came.
+*/
+void place_alert(timing_wheel_t* wheel, alert_t* alert) {
+    int ahead = alert->deadline - wheel->now, level = 0;
+
+    if (ahead <= 0) {
+        alert->level = -1;
+        alert->list = &wheel->overstaying;
+        wheel->num_overstaying++;
+    } else {
+        while (level < WHEEL_LEVELS - 1 &&
+            ahead >> (WHEEL_BITS * (level + 1)))
+            level++;
+        alert->level = level;
+        alert->list = &wheel->slots[level][(alert->deadline >>
+         (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+        wheel->counts[level]++;
+    }
+    alert->node = insert_list(alert->list, alert);
+}
+
+/**
+ * Takes a timer out of the slot or list it is in.
+*/
+void unplace_alert(timing_wheel_t* wheel, alert_t* alert) {
+    unlink_node(alert->list, alert->node);
+    if (alert->level < 0)
+        wheel->num_overstaying--;
+    else
+        wheel->counts[alert->level]--;
+}
+
+/**
+ * Places again the timers of a slot, now that the clock reached it.
+*/
+void cascade_slot(timing_wheel_t* wheel, list_t* slot) {
+    while (slot->head) {
+        alert_t* alert = (alert_t*)slot->head->val;
+        unplace_alert(wheel, alert);
+        place_alert(wheel, alert);
+    }
+}
+
+/**
+ * Moves the clock of the wheel forward to the given minute,
+ * firing the timers that come due on the way.
+*/
+void advance_alerts(timing_wheel_t* wheel, int minute) {
+    int scope = mem_scope(MEM_ALERTS);
+
+    while (wheel->now < minute) {
+        int level = 0, next;
+        while (level < WHEEL_LEVELS && !wheel->counts[level]) level++;
+        if (level == WHEEL_LEVELS) {
+            wheel->now = minute;
+            break;
+        }
+        // Nothing happens before the next slot of the lowest level in use
+        next = ((wheel->now >> (WHEEL_BITS * level)) + 1) <<
+         (WHEEL_BITS * level);
+        if (next > minute) {
+            wheel->now = minute;
+            break;
+        }
+        wheel->now = next;
+        for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+            int span = WHEEL_BITS * level;
+            if (next & ((1 << span) - 1)) continue;
+            cascade_slot(wheel, &wheel->slots[level][(next >> span) &
+             (WHEEL_SLOTS - 1)]);
+        }
+        cascade_slot(wheel, &wheel->slots[0][next & (WHEEL_SLOTS - 1)]);
+    }
+    mem_scope(scope);
+}
+
+/**
+ * Arms the timer of a vehicle that entered a park,
+ * if alerts are on.
+*/
+void arm_alert(timing_wheel_t* wheel, vehicle_t* vhc, park_t* park,
+                 int entry_time) {
+    if (!wheel->threshold) return;
+    int scope = mem_scope(MEM_ALERTS);
+    alert_t* alert = (alert_t*)safe_malloc(sizeof(alert_t));
+    alert->vehicle = vhc;
+    alert->park = park;
+    alert->deadline = entry_time + wheel->threshold;
+    place_alert(wheel, alert);
+    vhc->alert = alert;
+    mem_scope(scope);
+}
+
+/**
+ * Cancels the timer of a vehicle that left its park, if it has one.
+*/
+void cancel_alert(timing_wheel_t* wheel, vehicle_t* vhc) {
+    if (!vhc->alert) return;
+    unplace_alert(wheel, vhc->alert);
+    safe_free(vhc->alert);
+    vhc->alert = NULL;
+}
+
+/**
+ * Cancels every timer.
+*/
+void clear_alerts(timing_wheel_t* wheel) {
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+            list_t* list = &wheel->slots[level][slot];
+            while (list->head) {
+                cancel_alert(wheel, ((alert_t*)list->head->val)->vehicle);
+            }
+        }
+    }
+    while (wheel->overstaying.head) {
+        cancel_alert(wheel,
+         ((alert_t*)wheel->overstaying.head->val)->vehicle);
+    }
+}
+
+/**
+ * Frees the timing wheel and its timers.
+*/
+void free_alerts(timing_wheel_t* wheel) {
+    clear_alerts(wheel);
+    safe_free(wheel);
+}
+
+/**
+ * Sets the threshold of the alerts in hours (0 turns them off),
+ * arming the timers of the vehicles parked at the moment.
+ * Those already parked for longer overstay at once.
+*/
+void set_alert_threshold(int hours, system_t* sys) {
+    timing_wheel_t* wheel = sys->alerts;
+
+    clear_alerts(wheel);
+    wheel->threshold = hours * 60;
+    wheel->now = get_minute_index(sys->date_registry);
+    for (node_t* current = sys->parks->head; current != NULL;
+        current = current->next) {
+        park_t* park = (park_t*)current->val;
+        node_t* parked = park->park_vehicles->head;
+        for (; parked != NULL; parked = parked->next) {
+            vehicle_t* vhc = (vehicle_t*)parked->val;
+            arm_alert(wheel, vhc, park, get_minute_index(vhc->last_entry));
+        }
+    }
+}
+
+/**
+ * Compares overstaying vehicles by the minute they overstayed,
+ * then by license plate.
+*/
+int compare_alerts(const void* a, const void* b) {
+    alert_t* alert_a = *(alert_t**)a;
+    alert_t* alert_b = *(alert_t**)b;
+    if (alert_a->deadline != alert_b->deadline)
+        return alert_a->deadline < alert_b->deadline ? -1 : 1;
+    return strcmp(alert_a->vehicle->license_plate,
+     alert_b->vehicle->license_plate);
+}
+
+/**
+ * Shows the vehicles parked for longer than the threshold,
+ * by the minute they overstayed, with their entry and park.
+*/
+void print_alerts(timing_wheel_t* wheel) {
+    alert_t** alerts;
+    node_t* current = wheel->overstaying.head;
+    int i = 0;
+
+    if (!wheel->num_overstaying) return;
+    alerts = (alert_t**)safe_malloc(wheel->num_overstaying * sizeof(alert_t*));
+    for (; current != NULL; current = current->next) {
+        alerts[i++] = (alert_t*)current->val;
+    }
+    qsort(alerts, wheel->num_overstaying, sizeof(alert_t*), compare_alerts);
+    for (i = 0; i < wheel->num_overstaying; i++) {
+        vehicle_t* vhc = alerts[i]->vehicle;
+        printf("%s %02d-%02d-%4d %02d:%02d %s\n", vhc->license_plate,
+         vhc->last_entry.d, vhc->last_entry.mth, vhc->last_entry.y,
+         vhc->last_entry.h, vhc->last_entry.min,
+         alerts[i]->park->park_name);
+    }
+    safe_free(alerts);
+}
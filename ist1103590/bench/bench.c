@@ -0,0 +1,601 @@
+/**
+ * @file bench.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * Micro-benchmarks of the kernels the commands spend their time
+ * in, each run on its own over generated data of a few sizes.
+ * Every measurement repeats the kernel for at least a minimum
+ * time and reports the nanoseconds, cycles and allocations per
+ * operation, one line per kernel and size, separated by tabs, so
+ * two runs can be compared line by line. Cycles are counted with
+ * perf_event_open where the system allows it, and shown as '-'
+ * otherwise. The data is generated from a fixed seed, so every
+ * run measures the same work.
+ *
+ * Usage: bench [-t <ms>] [<kernel> ...]
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define BENCH_MAX_SIZES 5
+#define BENCH_MIN_MS 200 /* default minimum time of a measurement */
+#define BENCH_SEED 88172645463325252ULL
+#define BENCH_NAMES 4
+#define BENCH_USAGE "usage: %s [-t <ms>] [<kernel> ...]\n"
+#define BENCH_HEADER "kernel\tsize\tops\tns_op\tcycles_op\tallocs_op\n"
+
+/* generated data of a kernel, only the fields it uses are set */
+typedef struct {
+    int size;
+    timestamp_t* dates; /* two per operation: entry and exit */
+    tariff_t* tariffs;
+    char (*plates)[V_LICENSE_PLT_LENGTH];
+    char** lookups; /* the plates, in the order they are searched */
+    hash_table* ht;
+    list_t* list;
+    entry_t** entries;
+    char path[32]; /* file read as standard input */
+    char* buffer;
+} bench_data_t;
+
+typedef struct {
+    const char* name;
+    int sizes[BENCH_MAX_SIZES]; /* ended by 0 */
+    void (*setup)(bench_data_t* data);
+    void (*reset)(bench_data_t* data); /* before each run, not timed */
+    long long (*run)(bench_data_t* data); /* returns the operations */
+    void (*teardown)(bench_data_t* data);
+} kernel_t;
+
+/* results go here, so the compiler keeps the work that makes them */
+static volatile long long sink;
+
+static unsigned long long rng_state;
+
+static const char* bench_names[BENCH_NAMES] = {
+    "Saldanha", "\"CC Colombo\"", "Lumiar", "\"Campo Grande\""
+};
+
+/**
+ * Returns the next number of the generator (xorshift64).
+*/
+unsigned long long next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * Returns a random number from lo to hi, both inclusive.
+*/
+int random_between(int lo, int hi) {
+    return lo + (int)(next_random() % (unsigned)(hi - lo + 1));
+}
+
+/**
+ * Returns a random date and time of 2024 or 2025.
+*/
+timestamp_t random_date() {
+    timestamp_t date;
+    date.y = random_between(2024, 2025);
+    date.mth = random_between(1, 12);
+    date.d = random_between(1, 28);
+    date.h = random_between(0, 23);
+    date.min = random_between(0, 59);
+    return date;
+}
+
+/**
+ * Writes the i-th of a sequence of distinct valid plates: one pair
+ * of letters, at a position that changes with i, and two of digits.
+*/
+void make_plate(char* plate, int i) {
+    int letters = (i / 3) % 676, digits = (i / 3 / 676) % 10000;
+    for (int pair = 0; pair < 3; pair++) {
+        char* at = plate + 3 * pair;
+        if (pair == i % 3) {
+            at[0] = 'A' + letters / 26;
+            at[1] = 'A' + letters % 26;
+        } else {
+            at[0] = '0' + digits % 100 / 10;
+            at[1] = '0' + digits % 10;
+            digits /= 100;
+        }
+        at[2] = pair < 2 ? '-' : '\0';
+    }
+}
+
+/**
+ * Makes the data plates of the kernel, in order, and the same
+ * plates shuffled as the lookups.
+*/
+void make_plates(bench_data_t* data) {
+    data->plates = malloc(data->size * sizeof(*data->plates));
+    data->lookups = malloc(data->size * sizeof(char*));
+    for (int i = 0; i < data->size; i++) {
+        make_plate(data->plates[i], i);
+        data->lookups[i] = data->plates[i];
+    }
+    for (int i = data->size - 1; i > 0; i--) {
+        int j = random_between(0, i);
+        char* tmp = data->lookups[i];
+        data->lookups[i] = data->lookups[j];
+        data->lookups[j] = tmp;
+    }
+}
+
+/**
+ * Frees whatever data a kernel generated.
+*/
+void free_data(bench_data_t* data) {
+    free(data->dates);
+    free(data->tariffs);
+    free(data->plates);
+    free(data->lookups);
+    free(data->entries);
+    free(data->buffer);
+}
+
+/* calculate_facturation */
+
+/**
+ * Makes a stay and a tariff per operation.
+*/
+void setup_facturation(bench_data_t* data) {
+    data->dates = malloc(2 * data->size * sizeof(timestamp_t));
+    data->tariffs = malloc(data->size * sizeof(tariff_t));
+    for (int i = 0; i < data->size; i++) {
+        // Stays from a few minutes to a few days
+        int entry = random_between(0, 365 * MINS_IN_DAY);
+        int exit = entry + random_between(0, 3 * MINS_IN_DAY);
+        data->dates[2 * i] = minute_to_timestamp(entry);
+        data->dates[2 * i + 1] = minute_to_timestamp(exit);
+        data->tariffs[i].first_hour_price = random_between(1, 50) / 100.0;
+        data->tariffs[i].hour_price = random_between(50, 100) / 100.0;
+        data->tariffs[i].max_daily_price = random_between(10, 30);
+    }
+}
+
+/**
+ * Bills every stay with its tariff.
+*/
+long long run_facturation(bench_data_t* data) {
+    float total = 0;
+    for (int i = 0; i < data->size; i++) {
+        total += calculate_facturation(data->dates[2 * i],
+         data->dates[2 * i + 1], data->tariffs[i]);
+    }
+    sink += (long long)total;
+    return data->size;
+}
+
+/* is_license_plate */
+
+/**
+ * Makes the plates to check, a quarter of them invalid.
+*/
+void setup_license_plate(bench_data_t* data) {
+    make_plates(data);
+    // A quarter of the plates are made invalid in one character
+    for (int i = 0; i < data->size; i += 4) {
+        data->plates[i][random_between(0, 7)] = "a-Z9"[i / 4 % 4];
+    }
+}
+
+/**
+ * Checks every plate.
+*/
+long long run_license_plate(bench_data_t* data) {
+    long long valid = 0;
+    for (int i = 0; i < data->size; i++) {
+        valid += is_license_plate(data->lookups[i]);
+    }
+    sink += valid;
+    return data->size;
+}
+
+/* hash, search_ht and search_ht_batch */
+
+/**
+ * Hashes every plate.
+*/
+long long run_hash(bench_data_t* data) {
+    unsigned int h = 0;
+    for (int i = 0; i < data->size; i++) {
+        h ^= hash(data->lookups[i]);
+    }
+    sink += h;
+    return data->size;
+}
+
+/**
+ * Inserts a vehicle per plate into a new hash table.
+*/
+void setup_search_ht(bench_data_t* data) {
+    make_plates(data);
+    data->ht = init_ht();
+    for (int i = 0; i < data->size; i++) {
+        vehicle_t* vhc = (vehicle_t*)safe_malloc(sizeof(vehicle_t));
+        memset(vhc, 0, sizeof(vehicle_t));
+        strcpy(vhc->license_plate, data->plates[i]);
+        insert_ht(data->ht, vhc);
+    }
+}
+
+/**
+ * Searches every plate, one at a time.
+*/
+long long run_search_ht(bench_data_t* data) {
+    long long found = 0;
+    for (int i = 0; i < data->size; i++) {
+        found += search_ht(data->ht, data->lookups[i]) != NULL;
+    }
+    sink += found;
+    return data->size;
+}
+
+/**
+ * Searches the same plates as run_search_ht, a chunk of the
+ * 'b' command at a time, as bulk_resolve does.
+*/
+long long run_search_ht_batch(bench_data_t* data) {
+    vehicle_t* vehicles[BULK_CHUNK];
+    long long found = 0;
+    for (int base = 0; base < data->size; base += BULK_CHUNK) {
+        int n = data->size - base < BULK_CHUNK ? data->size - base :
+         BULK_CHUNK;
+        search_ht_batch(data->ht, data->lookups + base, n, vehicles);
+        for (int i = 0; i < n; i++) {
+            found += vehicles[i] != NULL;
+        }
+    }
+    sink += found;
+    return data->size;
+}
+
+/**
+ * Frees the hash table and its vehicles.
+*/
+void teardown_search_ht(bench_data_t* data) {
+    free_hashtable(data->ht);
+}
+
+/* get_time_in_mins and compare_date_time */
+
+/**
+ * Makes a date per operation, and one more to compare the last to.
+*/
+void setup_dates(bench_data_t* data) {
+    data->dates = malloc((data->size + 1) * sizeof(timestamp_t));
+    for (int i = 0; i <= data->size; i++) {
+        data->dates[i] = random_date();
+    }
+}
+
+/**
+ * Converts every date to minutes.
+*/
+long long run_time_in_mins(bench_data_t* data) {
+    long long total = 0;
+    for (int i = 0; i < data->size; i++) {
+        total += get_time_in_mins(data->dates[i]);
+    }
+    sink += total;
+    return data->size;
+}
+
+/**
+ * Compares every date to the next one.
+*/
+long long run_compare_date_time(bench_data_t* data) {
+    long long total = 0;
+    for (int i = 0; i < data->size; i++) {
+        total += compare_date_time(data->dates[i], data->dates[i + 1]);
+    }
+    sink += total;
+    return data->size;
+}
+
+/* sorted_insert_list */
+
+/**
+ * Makes the dates of the entries to insert.
+*/
+void setup_sorted_insert(bench_data_t* data) {
+    setup_dates(data);
+    data->entries = malloc(data->size * sizeof(entry_t*));
+}
+
+/**
+ * Starts an empty list and new entries to insert into it,
+ * freeing the ones of the run before.
+*/
+void reset_sorted_insert(bench_data_t* data) {
+    if (data->list) delete_list(data->list);
+    data->list = init_list();
+    for (int i = 0; i < data->size; i++) {
+        entry_t* entry = (entry_t*)safe_malloc(sizeof(entry_t));
+        entry->park_id = 0;
+        entry->vehicle = NULL;
+        entry->entry_date_time = data->dates[i];
+        data->entries[i] = entry;
+    }
+}
+
+/**
+ * Inserts every entry into the list, in the order of the dates.
+*/
+long long run_sorted_insert(bench_data_t* data) {
+    for (int i = 0; i < data->size; i++) {
+        sorted_insert_list(data->list, data->entries[i], ENTRY_COMMAND);
+    }
+    sink += data->list->head != NULL;
+    return data->size;
+}
+
+/**
+ * Frees the list of the last run and its entries.
+*/
+void teardown_sorted_insert(bench_data_t* data) {
+    if (data->list) delete_list(data->list);
+}
+
+/* read_name and scanf, as the 'e' command parses its arguments */
+
+/**
+ * Writes the arguments of as many 'e' commands to a file and
+ * reads the standard input from it.
+*/
+void setup_parse(bench_data_t* data) {
+    strcpy(data->path, "/tmp/bench-XXXXXX");
+    int fd = mkstemp(data->path);
+    FILE* file = fd < 0 ? NULL : fdopen(fd, "w");
+    if (!file) {
+        perror(data->path);
+        exit(EXIT_FAILURE);
+    }
+    make_plates(data);
+    for (int i = 0; i < data->size; i++) {
+        timestamp_t date = random_date();
+        fprintf(file, " %s %s %02d-%02d-%4d %02d:%02d\n",
+         bench_names[i % BENCH_NAMES], data->lookups[i], date.d,
+         date.mth, date.y, date.h, date.min);
+    }
+    fclose(file);
+    if (!freopen(data->path, "r", stdin)) {
+        perror(data->path);
+        exit(EXIT_FAILURE);
+    }
+    data->buffer = malloc(MAX_LINE_SIZE);
+}
+
+/**
+ * Reads the file from its start again.
+*/
+void reset_parse(bench_data_t* data) {
+    (void)data;
+    rewind(stdin);
+}
+
+/**
+ * Parses the arguments of every 'e' command of the file.
+*/
+long long run_parse(bench_data_t* data) {
+    char plate[MAX_LINE_SIZE];
+    timestamp_t date;
+    long long total = 0;
+
+    for (int i = 0; i < data->size; i++) {
+        read_spaces();
+        char* name = parse_allocate_name(data->buffer);
+        read_spaces();
+        scanf("%s", plate);
+        total += scanf("%02d-%02d-%4d %02d:%02d", &date.d, &date.mth,
+         &date.y, &date.h, &date.min);
+        read_until_end(data->buffer);
+        total += name[0];
+        safe_free(name);
+    }
+    sink += total;
+    return data->size;
+}
+
+/**
+ * Removes the file the arguments were written to.
+*/
+void teardown_parse(bench_data_t* data) {
+    unlink(data->path);
+}
+
+static const kernel_t kernels[] = {
+    {"calculate_facturation", {1000, 100000, 0}, setup_facturation,
+     NULL, run_facturation, NULL},
+    {"is_license_plate", {1000, 100000, 0}, setup_license_plate,
+     NULL, run_license_plate, NULL},
+    {"hash", {1000, 100000, 1000000, 0}, make_plates,
+     NULL, run_hash, NULL},
+    {"search_ht", {1000, 100000, 1000000, 10000000, 0}, setup_search_ht,
+     NULL, run_search_ht, teardown_search_ht},
+    {"search_ht_batch", {1000, 100000, 1000000, 10000000, 0},
+     setup_search_ht, NULL, run_search_ht_batch, teardown_search_ht},
+    {"get_time_in_mins", {1000, 100000, 0}, setup_dates,
+     NULL, run_time_in_mins, NULL},
+    {"compare_date_time", {1000, 100000, 0}, setup_dates,
+     NULL, run_compare_date_time, NULL},
+    {"sorted_insert_list", {100, 1000, 10000, 0}, setup_sorted_insert,
+     reset_sorted_insert, run_sorted_insert, teardown_sorted_insert},
+    {"parse_entry", {1000, 100000, 0}, setup_parse,
+     reset_parse, run_parse, teardown_parse},
+};
+
+#define NUM_KERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+/**
+ * Opens a counter of the cycles spent by this process in user
+ * space, stopped. Returns its descriptor, or -1 if the system
+ * does not allow it.
+*/
+int open_cycle_counter() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+/**
+ * Starts (or with FALSE, stops) counting cycles.
+*/
+void count_cycles(int fd, int on) {
+#ifdef __linux__
+    if (fd >= 0)
+        ioctl(fd, on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+#else
+    (void)fd;
+    (void)on;
+#endif
+}
+
+/**
+ * Returns the cycles counted so far, or -1 without a counter.
+*/
+long long read_cycles(int fd) {
+    long long cycles;
+    if (fd < 0 || read(fd, &cycles, sizeof(cycles)) != sizeof(cycles))
+        return -1;
+    return cycles;
+}
+
+/**
+ * Returns the current time in nanoseconds.
+*/
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Measures a kernel on data of the given size, running it once
+ * to warm up and then until the minimum time has passed, and
+ * prints its line of results.
+*/
+void measure(const kernel_t* kernel, int size, long long min_ns,
+               int cycle_fd) {
+    bench_data_t data;
+    long long ops = 0, ns = 0, allocations = 0;
+    long long cycles_before = read_cycles(cycle_fd);
+
+    memset(&data, 0, sizeof(data));
+    data.size = size;
+    rng_state = BENCH_SEED;
+    kernel->setup(&data);
+    for (int warm = TRUE; warm || ns < min_ns; warm = FALSE) {
+        if (kernel->reset) kernel->reset(&data);
+        long long allocations_before = mem_allocations();
+        long long start = now_ns();
+        count_cycles(cycle_fd, TRUE);
+        long long done = kernel->run(&data);
+        count_cycles(cycle_fd, FALSE);
+        long long elapsed = now_ns() - start;
+        if (warm) {
+            cycles_before = read_cycles(cycle_fd);
+            continue;
+        }
+        ns += elapsed;
+        ops += done;
+        allocations += mem_allocations() - allocations_before;
+    }
+    long long cycles = read_cycles(cycle_fd);
+    if (kernel->teardown) kernel->teardown(&data);
+    free_data(&data);
+
+    printf("%s\t%d\t%lld\t%.2f\t", kernel->name, size, ops,
+     (double)ns / ops);
+    if (cycles >= 0 && cycles_before >= 0)
+        printf("%.2f", (double)(cycles - cycles_before) / ops);
+    else
+        printf("-");
+    printf("\t%.3f\n", (double)allocations / ops);
+    fflush(stdout);
+}
+
+/**
+ * Checks whether a kernel was asked for: by name, or by
+ * asking for none.
+*/
+int selected(const char* name, int argc, char* argv[], int first) {
+    if (first == argc) return TRUE;
+    for (int i = first; i < argc; i++) {
+        if (!strcmp(argv[i], name)) return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * Shows how the benchmarks are run and which kernels there are.
+ * Returns the exit status of a wrong invocation.
+*/
+int usage(char* program) {
+    fprintf(stderr, BENCH_USAGE, program);
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        fprintf(stderr, "  %s\n", kernels[k].name);
+    }
+    return EXIT_FAILURE;
+}
+
+/**
+ * Measures the kernels given, or all of them, at each of their
+ * sizes. Returns EXIT_FAILURE on a wrong invocation.
+*/
+int main(int argc, char* argv[]) {
+    long long min_ms = BENCH_MIN_MS;
+    int first = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-t")) {
+        min_ms = atoll(argv[2]);
+        first = 3;
+    }
+    if (min_ms <= 0) return usage(argv[0]);
+    for (int i = first; i < argc; i++) {
+        int known = FALSE;
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            known |= !strcmp(argv[i], kernels[k].name);
+        }
+        if (!known) return usage(argv[0]);
+    }
+
+    int cycle_fd = open_cycle_counter();
+    printf(BENCH_HEADER);
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        if (!selected(kernels[k].name, argc, argv, first)) continue;
+        for (int s = 0; kernels[k].sizes[s]; s++) {
+            measure(&kernels[k], kernels[k].sizes[s], min_ms * 1000000LL,
+             cycle_fd);
+        }
+    }
+    if (cycle_fd >= 0) close(cycle_fd);
+    return EXIT_SUCCESS;
+}
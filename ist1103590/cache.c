@@ -0,0 +1,182 @@
+/**
+ * @file cache.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the cache of query results, for dashboards
+ * that repeat the same queries between movements. The output of
+ * a query is kept with the version of the park or vehicle it
+ * depends on, which every movement bumps, so a stale result is
+ * told apart in O(1) and dropped. Changes that affect many
+ * results at once (removing a park, aging out movements) bump
+ * the epoch of the cache instead. The least recently used
+ * results are evicted to keep the cache within its bounds.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/**
+ * Creates a new empty query cache.
+*/
+query_cache_t* init_query_cache() {
+    int scope = mem_scope(MEM_CACHE);
+    query_cache_t* cache = (query_cache_t*)safe_malloc(sizeof(query_cache_t));
+    cache->entries = init_list();
+    cache->size = 0;
+    cache->bytes = 0;
+    cache->epoch = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->saved_stdout = NULL;
+    cache->capture = NULL;
+    cache->capture_len = 0;
+    mem_scope(scope);
+    return cache;
+}
+
+/**
+ * Removes a result from the cache.
+*/
+void drop_cached_query(query_cache_t* cache, cached_query_t* cached) {
+    unlink_node(cache->entries, cached->node);
+    cache->size--;
+    cache->bytes -= cached->len;
+    safe_free(cached->key);
+    safe_free(cached->result);
+    safe_free(cached);
+}
+
+/**
+ * Removes every result from the cache.
+*/
+void clear_query_cache(query_cache_t* cache) {
+    while (cache->entries->head) {
+        drop_cached_query(cache, (cached_query_t*)cache->entries->head->val);
+    }
+}
+
+/**
+ * Frees the query cache and every result in it.
+*/
+void free_query_cache(query_cache_t* cache) {
+    clear_query_cache(cache);
+    safe_free(cache->entries);
+    safe_free(cache);
+}
+
+/**
+ * Makes every result in the cache stale.
+*/
+void invalidate_query_cache(query_cache_t* cache) {
+    cache->epoch++;
+}
+
+/**
+ * Returns the cached result of the given query, or NULL.
+*/
+cached_query_t* find_cached_query(query_cache_t* cache, char* key,
+                                    unsigned int h) {
+    node_t* current = cache->entries->head;
+    for (; current != NULL; current = current->next) {
+        cached_query_t* cached = (cached_query_t*)current->val;
+        if (cached->hash == h && !strcmp(cached->key, key))
+            return cached;
+    }
+    return NULL;
+}
+
+/**
+ * Prints the cached result of a query if there is one that is
+ * still valid for the given version, making it the most recently
+ * used. A stale result is dropped.
+ * Returns TRUE if the result was printed.
+*/
+int serve_cached_query(query_cache_t* cache, char* key,
+                         unsigned int version) {
+    cached_query_t* cached = find_cached_query(cache, key, hash(key));
+
+    if (cached && (cached->epoch != cache->epoch ||
+        cached->version != version)) {
+        drop_cached_query(cache, cached);
+        cached = NULL;
+    }
+    if (!cached) {
+        cache->misses++;
+        return FALSE;
+    }
+    int scope = mem_scope(MEM_CACHE);
+    unlink_node(cache->entries, cached->node);
+    cached->node = insert_list(cache->entries, cached);
+    mem_scope(scope);
+    fwrite(cached->result, 1, cached->len, stdout);
+    cache->hits++;
+    return TRUE;
+}
+
+/**
+ * Starts capturing what is printed, to keep it in the cache.
+ * If the output cannot be captured, it is printed as usual.
+*/
+void begin_query_capture(query_cache_t* cache) {
+    FILE* capture = open_memstream(&cache->capture, &cache->capture_len);
+    if (!capture) return;
+    fflush(stdout);
+    cache->saved_stdout = stdout;
+    stdout = capture;
+}
+
+/**
+ * Stops capturing the output of a query, prints it and keeps
+ * it in the cache with the given version, evicting the least
+ * recently used results to make room. Results too large for
+ * the cache are only printed.
+*/
+void end_query_capture(query_cache_t* cache, char* key,
+                         unsigned int version) {
+    if (!cache->saved_stdout) return;
+    fclose(stdout);
+    stdout = cache->saved_stdout;
+    cache->saved_stdout = NULL;
+
+    int len = (int)cache->capture_len;
+    fwrite(cache->capture, 1, len, stdout);
+    if (len <= QUERY_CACHE_BYTES / 4) {
+        int scope = mem_scope(MEM_CACHE);
+        while (cache->size >= QUERY_CACHE_SIZE ||
+            (cache->size && cache->bytes + len > QUERY_CACHE_BYTES)) {
+            drop_cached_query(cache,
+             (cached_query_t*)cache->entries->head->val);
+        }
+        cached_query_t* cached =
+         (cached_query_t*)safe_malloc(sizeof(cached_query_t));
+        cached->key = duplicate_string(key);
+        cached->hash = hash(key);
+        cached->result = (char*)safe_malloc(len + 1);
+        memcpy(cached->result, cache->capture, len);
+        cached->len = len;
+        cached->version = version;
+        cached->epoch = cache->epoch;
+        cached->node = insert_list(cache->entries, cached);
+        cache->size++;
+        cache->bytes += len;
+        mem_scope(scope);
+    }
+    // the buffer of a memory stream comes from malloc, not safe_malloc
+    free(cache->capture);
+    cache->capture = NULL;
+    cache->capture_len = 0;
+}
+
+/**
+ * Prints how many queries were answered from the cache.
+*/
+void print_cache_stats(query_cache_t* cache) {
+    printf("cache_hits %lld\n", cache->hits);
+    printf("cache_misses %lld\n", cache->misses);
+}
@@ -48,6 +48,48 @@ int get_month_mins(int month, int year) {
 	return min_sum;
 }
 
+/*
+ * Turns a date into the number of days elapsed since
+ * the first day of the program (01-01-2024).
+ * Unlike get_time_in_mins, every calendar day maps
+ * to a distinct, consecutive value.
+ */
+int get_day_index(timestamp_t ts) {
+	int days = 0, yr;
+	for (yr = 2024; yr < ts.y; yr++) {
+		days += 365 + is_leap_year(yr);
+	}
+	days += get_month_mins(ts.mth - 1, ts.y) / MINS_IN_DAY;
+	return days + ts.d - 1;
+}
+
+/*
+ * Turns a date into the number of minutes elapsed since
+ * the first minute of the program (01-01-2024 00:00).
+ */
+int get_minute_index(timestamp_t ts) {
+	return get_day_index(ts) * MINS_IN_DAY + ts.h * 60 + ts.min;
+}
+
+/*
+ * Turns a minute index (see get_minute_index) back into a date.
+ */
+timestamp_t minute_to_timestamp(int minute) {
+	timestamp_t ts;
+	int days = minute / MINS_IN_DAY;
+
+	ts.h = (minute % MINS_IN_DAY) / 60;
+	ts.min = minute % 60;
+	for (ts.y = 2024; days >= 365 + is_leap_year(ts.y); ts.y++) {
+		days -= 365 + is_leap_year(ts.y);
+	}
+	for (ts.mth = 1; ts.mth < 12 &&
+		days >= get_month_mins(ts.mth, ts.y) / MINS_IN_DAY; ts.mth++);
+	days -= get_month_mins(ts.mth - 1, ts.y) / MINS_IN_DAY;
+	ts.d = days + 1;
+	return ts;
+}
+
 /**
  * Compares dates and time in minutes
  * returning TRUE if d1 is after d2, 
@@ -0,0 +1,179 @@
+/**
+ * @file durations.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing functions used to keep the distribution of the
+ * stay lengths of each park. Every exit adds its stay, in minutes,
+ * to the histogram of its park and day, whose buckets split each
+ * power of two in a few linear steps, so a bucket is never wider
+ * than an eighth of the values in it. Percentiles over a range of
+ * days, of one park or of all parks, add the buckets up instead of
+ * going through the exits.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/**
+ * Creates a new empty histogram.
+*/
+duration_histogram_t* init_histogram() {
+    duration_histogram_t* histogram =
+     (duration_histogram_t*)safe_malloc(sizeof(duration_histogram_t));
+    memset(histogram->counts, 0, sizeof(histogram->counts));
+    return histogram;
+}
+
+/**
+ * Returns the bucket of a stay length, in minutes. Lengths under
+ * 2^DURATION_SUB_BITS have a bucket each, longer ones share one
+ * with those of the same power of two and leading bits.
+*/
+int duration_bucket(int minutes) {
+    int sub = 1 << DURATION_SUB_BITS, k = DURATION_SUB_BITS;
+
+    if (minutes < sub) return minutes < 0 ? 0 : minutes;
+    while (k < DURATION_MAX_LOG && (minutes >> (k + 1))) k++;
+    if (minutes >> (k + 1)) return DURATION_BUCKETS - 1;
+    return ((k - DURATION_SUB_BITS + 1) << DURATION_SUB_BITS) +
+     ((minutes >> (k - DURATION_SUB_BITS)) & (sub - 1));
+}
+
+/**
+ * Returns the longest stay length, in minutes, that falls in a bucket.
+*/
+int bucket_highest(int bucket) {
+    int sub = 1 << DURATION_SUB_BITS;
+    int k = (bucket >> DURATION_SUB_BITS) + DURATION_SUB_BITS - 1;
+
+    if (bucket < sub) return bucket;
+    return ((sub + (bucket & (sub - 1)) + 1) << (k - DURATION_SUB_BITS)) - 1;
+}
+
+/**
+ * Adds the counts of a histogram to another.
+*/
+void histogram_merge(duration_histogram_t* into,
+                       duration_histogram_t* from) {
+    for (int i = 0; i < DURATION_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+}
+
+/**
+ * Returns the number of stays in a histogram.
+*/
+long long histogram_total(duration_histogram_t* histogram) {
+    long long total = 0;
+    for (int i = 0; i < DURATION_BUCKETS; i++) {
+        total += histogram->counts[i];
+    }
+    return total;
+}
+
+/**
+ * Returns the stay length, in minutes, that the given percentage
+ * of the stays in a histogram do not exceed, rounded up to the
+ * end of its bucket. Returns 0 if the histogram is empty.
+*/
+int histogram_percentile(duration_histogram_t* histogram, int percent) {
+    long long rank = (histogram_total(histogram) * percent + 99) / 100;
+    long long seen = 0;
+
+    if (rank < 1) rank = 1;
+    for (int i = 0; i < DURATION_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) return bucket_highest(i);
+    }
+    return 0;
+}
+
+/**
+ * Prints the counts of a histogram on one line.
+*/
+void print_histogram(duration_histogram_t* histogram) {
+    for (int i = 0; i < DURATION_BUCKETS; i++) {
+        printf(i ? " %d" : "%d", histogram->counts[i]);
+    }
+    printf("\n");
+}
+
+/**
+ * Reads the counts of a histogram printed by print_histogram.
+ * Returns FALSE if the line is not a histogram.
+*/
+int read_histogram(duration_histogram_t* histogram, char* line) {
+    int offset;
+    for (int i = 0; i < DURATION_BUCKETS; i++) {
+        if (!isdigit(*line) ||
+            sscanf(line, "%d%n", &histogram->counts[i], &offset) != 1)
+            return FALSE;
+        line += offset;
+        if (*line == ' ') line++;
+    }
+    return *line == '\n';
+}
+
+/**
+ * Counts the stay of an exit in the histogram of its day.
+*/
+void count_duration(daily_t* durations, int day, int minutes) {
+    duration_histogram_t* histogram =
+     (duration_histogram_t*)daily_bucket(durations, day);
+    histogram->counts[duration_bucket(minutes)]++;
+}
+
+/**
+ * Adds up the histograms of a park between two days (both inclusive).
+*/
+void merge_durations(duration_histogram_t* into, daily_t* durations,
+                       int from_day, int to_day) {
+    for (int day = from_day; day <= to_day && day < durations->size; day++) {
+        if (durations->days[day])
+            histogram_merge(into, (duration_histogram_t*)durations->days[day]);
+    }
+}
+
+/**
+ * Prints the number of stays in a histogram and the median,
+ * 90th and 99th percentile of their lengths, in minutes.
+*/
+void print_percentiles(duration_histogram_t* histogram) {
+    printf("%lld %d %d %d\n", histogram_total(histogram),
+     histogram_percentile(histogram, 50),
+     histogram_percentile(histogram, 90),
+     histogram_percentile(histogram, 99));
+}
+
+/**
+ * Shows the distribution of the stays that ended in the given park,
+ * or in any park if none is given, between two dates (both
+ * inclusive). In router mode the workers print the merged histogram
+ * instead, for the router to add theirs up.
+*/
+void print_stay_durations(park_t* park, timestamp_t from,
+                            timestamp_t to, system_t* sys) {
+    duration_histogram_t* merged = init_histogram();
+    int from_day = get_day_index(from), to_day = get_day_index(to);
+
+    if (park) {
+        merge_durations(merged, park->durations, from_day, to_day);
+    } else {
+        node_t* current = sys->parks->head;
+        for (; current != NULL; current = current->next) {
+            merge_durations(merged, ((park_t*)current->val)->durations,
+             from_day, to_day);
+        }
+    }
+    if (sys->raw_sketches)
+        print_histogram(merged);
+    else
+        print_percentiles(merged);
+    safe_free(merged);
+}
@@ -0,0 +1,309 @@
+/**
+ * @file events.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the stream of occupancy changes, for displays
+ * showing the free spots of a park. Every entry and exit puts the
+ * new free spots of its park in a bounded ring that any thread can
+ * add to without locks, and the ring is emptied between commands
+ * into the subscribers: files, pipes or sockets, written without
+ * blocking. A subscriber that does not keep up is not waited for:
+ * the parks it misses are marked, and once it catches up it gets
+ * only their latest free spots. If the ring itself fills up, the
+ * park is marked the same way for every subscriber.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/**
+ * Creates a new stream of occupancy changes, with no subscribers.
+*/
+event_stream_t* init_events() {
+    event_stream_t* events = (event_stream_t*)safe_malloc(
+     sizeof(event_stream_t));
+    memset(events, 0, sizeof(event_stream_t));
+    for (unsigned int i = 0; i < EVENTS_RING; i++) {
+        events->ring[i].sequence = i;
+    }
+    return events;
+}
+
+/**
+ * Puts the free spots of a park in the ring, if anyone listens.
+ * Several threads may publish at once: each claims the next slot
+ * and marks it as written once it is, so the slot is read whole.
+ * A full ring leaves the park marked as changed instead.
+*/
+void publish_occupancy(event_stream_t* events, park_t* park) {
+    unsigned int pos;
+    occupancy_event_t* event;
+
+    if (!events->num_subscribers) return;
+    pos = __atomic_load_n(&events->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        event = &events->ring[pos & (EVENTS_RING - 1)];
+        int lag = (int)(__atomic_load_n(&event->sequence, __ATOMIC_ACQUIRE)
+         - pos);
+        if (lag < 0) {
+            __atomic_store_n(&events->missed[park->id], TRUE,
+             __ATOMIC_RELAXED);
+            __atomic_store_n(&events->any_missed, TRUE, __ATOMIC_RELEASE);
+            return;
+        }
+        if (lag == 0 && __atomic_compare_exchange_n(&events->tail, &pos,
+             pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+        if (lag > 0)
+            pos = __atomic_load_n(&events->tail, __ATOMIC_RELAXED);
+    }
+    event->park_id = park->id;
+    event->free = park->park_capacity - park->num_vehicles;
+    __atomic_store_n(&event->sequence, pos + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Writes as much of the pending line of a subscriber as it takes
+ * now. Returns FALSE if some of it is still pending.
+*/
+int write_pending(subscriber_t* sub) {
+    while (sub->pending_len) {
+        ssize_t written = write(sub->fd, sub->pending, sub->pending_len);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                sub->closed = TRUE;
+            return FALSE;
+        }
+        sub->pending_len -= written;
+        memmove(sub->pending, sub->pending + written, sub->pending_len);
+    }
+    return TRUE;
+}
+
+/**
+ * Writes the free spots of a park to a subscriber, keeping
+ * what it does not take yet as pending.
+*/
+void write_occupancy(subscriber_t* sub, park_t* park, int free) {
+    sub->pending_len = snprintf(sub->pending, EVENTS_LINE_SIZE, "%s %d\n",
+     park->park_name, free);
+    if (sub->pending_len >= EVENTS_LINE_SIZE)
+        sub->pending_len = EVENTS_LINE_SIZE - 1;
+    write_pending(sub);
+}
+
+/**
+ * Marks a park as changed for a subscriber, to be sent
+ * its latest free spots once the subscriber catches up.
+*/
+void mark_changed(subscriber_t* sub, int park_id) {
+    if (sub->park_id != INVALID && sub->park_id != park_id) return;
+    if (!sub->changed[park_id]) {
+        sub->changed[park_id] = TRUE;
+        sub->num_changed++;
+    }
+}
+
+/**
+ * Sends a change of the free spots of a park to a subscriber,
+ * or marks it if the subscriber is still behind.
+*/
+void deliver_occupancy(subscriber_t* sub, int park_id, int free,
+                         system_t* sys) {
+    if (sub->closed ||
+        (sub->park_id != INVALID && sub->park_id != park_id))
+        return;
+    if (sub->pending_len || sub->num_changed) {
+        mark_changed(sub, park_id);
+        return;
+    }
+    if (sys->park_ids[park_id])
+        write_occupancy(sub, sys->park_ids[park_id], free);
+}
+
+/**
+ * Sends a subscriber that fell behind what it missed: the rest of
+ * its pending line, then the current free spots of each park that
+ * changed meanwhile, for as long as it takes them.
+*/
+void catch_up(subscriber_t* sub, system_t* sys) {
+    for (int id = 0; id < MAX_P && sub->num_changed; id++) {
+        if (!write_pending(sub)) return;
+        if (!sub->changed[id]) continue;
+        sub->changed[id] = FALSE;
+        sub->num_changed--;
+        park_t* park = sys->park_ids[id];
+        if (park)
+            write_occupancy(sub, park, park->park_capacity -
+             park->num_vehicles);
+    }
+    write_pending(sub);
+}
+
+/**
+ * Closes a subscriber and takes it out of the stream.
+*/
+void drop_subscriber(event_stream_t* events, int i) {
+    close(events->subscribers[i].fd);
+    safe_free(events->subscribers[i].path);
+    events->subscribers[i] = events->subscribers[--events->num_subscribers];
+}
+
+/**
+ * Empties the ring into the subscribers, then lets those that
+ * fell behind catch up with the latest free spots, which are
+ * newer than anything in the ring. Called between commands,
+ * when no park is being changed.
+*/
+void pump_events(system_t* sys) {
+    event_stream_t* events = sys->events;
+    int i;
+
+    if (!events->num_subscribers) return;
+    for (;;) {
+        occupancy_event_t* event =
+         &events->ring[events->head & (EVENTS_RING - 1)];
+        if (__atomic_load_n(&event->sequence, __ATOMIC_ACQUIRE) !=
+            events->head + 1)
+            break;
+        for (i = 0; i < events->num_subscribers; i++) {
+            deliver_occupancy(&events->subscribers[i], event->park_id,
+             event->free, sys);
+        }
+        __atomic_store_n(&event->sequence, events->head + EVENTS_RING,
+         __ATOMIC_RELEASE);
+        events->head++;
+    }
+    if (__atomic_exchange_n(&events->any_missed, FALSE, __ATOMIC_ACQUIRE)) {
+        for (int id = 0; id < MAX_P; id++) {
+            if (!__atomic_exchange_n(&events->missed[id], FALSE,
+                 __ATOMIC_RELAXED))
+                continue;
+            for (i = 0; i < events->num_subscribers; i++) {
+                mark_changed(&events->subscribers[i], id);
+            }
+        }
+    }
+    for (i = events->num_subscribers - 1; i >= 0; i--) {
+        catch_up(&events->subscribers[i], sys);
+        if (events->subscribers[i].closed) drop_subscriber(events, i);
+    }
+}
+
+/**
+ * Opens a file, pipe or socket for writing without blocking.
+ * Returns its descriptor, or -1 if it cannot be opened.
+*/
+int open_subscriber(char* path) {
+    struct stat st;
+    int fd;
+
+    if (stat(path, &st) || !S_ISSOCK(st.st_mode))
+        return open(path, O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK, 0644);
+
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Subscribes a file, pipe or socket to the changes of the given
+ * park, or of every park if none is given, starting with their
+ * current free spots.
+*/
+void subscribe(char* path, park_t* park, system_t* sys) {
+    event_stream_t* events = sys->events;
+
+    if (events->num_subscribers == EVENTS_MAX_SUBSCRIBERS) {
+        printf(EVENTS_TOO_MANY);
+        return;
+    }
+    int fd = open_subscriber(path);
+    if (fd < 0) {
+        printf(SNAPSHOT_NO_FILE, path);
+        return;
+    }
+    // A reader that goes away must not end the program
+    signal(SIGPIPE, SIG_IGN);
+    subscriber_t* sub = &events->subscribers[events->num_subscribers++];
+    memset(sub, 0, sizeof(subscriber_t));
+    sub->path = duplicate_string(path);
+    sub->fd = fd;
+    sub->park_id = park ? park->id : INVALID;
+    for (int id = 0; id < MAX_P; id++) {
+        if (sys->park_ids[id]) mark_changed(sub, id);
+    }
+    catch_up(sub, sys);
+}
+
+/**
+ * Returns the number of subscribers to the park with the given id,
+ * or with INVALID, to every park.
+*/
+int count_subscribers(event_stream_t* events, int park_id) {
+    int count = 0;
+    for (int i = 0; i < events->num_subscribers; i++) {
+        count += events->subscribers[i].park_id == park_id;
+    }
+    return count;
+}
+
+/**
+ * Forgets a park that was removed: nothing more is sent about it,
+ * and its own subscribers are closed, since its id may be reused.
+*/
+void forget_park_events(event_stream_t* events, int park_id) {
+    events->missed[park_id] = FALSE;
+    for (int i = events->num_subscribers - 1; i >= 0; i--) {
+        subscriber_t* sub = &events->subscribers[i];
+        if (sub->park_id == park_id) {
+            drop_subscriber(events, i);
+        } else if (sub->changed[park_id]) {
+            sub->changed[park_id] = FALSE;
+            sub->num_changed--;
+        }
+    }
+}
+
+/**
+ * Sends the subscribers what they missed, waiting a little for
+ * those that fell behind to take it, and frees them.
+*/
+void free_events(system_t* sys) {
+    event_stream_t* events = sys->events;
+
+    pump_events(sys);
+    while (events->num_subscribers) {
+        subscriber_t* sub = &events->subscribers[0];
+        struct pollfd ready = {sub->fd, POLLOUT, 0};
+        while (!sub->closed && (sub->pending_len || sub->num_changed) &&
+            poll(&ready, 1, EVENTS_CLOSE_WAIT) > 0)
+            catch_up(sub, sys);
+        drop_subscriber(events, 0);
+    }
+    safe_free(events);
+}
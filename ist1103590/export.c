@@ -0,0 +1,184 @@
+/**
+ * @file export.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the export of completed stays to a columnar
+ * binary file, for analytics. Only the stays that ended from a
+ * given watermark up to the current minute are written, and the
+ * current minute is the watermark of the next export, so nightly
+ * exports only write new stays. The export runs in a snapshot of
+ * the system while commands keep being processed, writing one
+ * chunk of rows at a time.
+ *
+ * Every number is little endian. The file starts with the magic
+ * "PKCX", its version, the number of columns and the watermarks
+ * it covers (4 bytes each). Then come the chunks: the number of
+ * rows (4 bytes), then for each column its id and width (1 byte
+ * each), its smallest and largest value (8 bytes each) and its
+ * values. A chunk of zero rows ends the file, followed by the
+ * total number of rows (8 bytes).
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+
+/* bytes of the values of each column */
+static const int column_widths[EXPORT_COLUMNS] = {8, 4, 4, 8, 4};
+
+/**
+ * Writes the lowest bytes of a number, little endian.
+*/
+void write_le(FILE* out, unsigned long long value, int width) {
+    for (int i = 0; i < width; i++) {
+        fputc((int)(value & 0xff), out);
+        value >>= 8;
+    }
+}
+
+/**
+ * Returns the characters of a license plate as a number,
+ * ordered as the plates are.
+*/
+long long plate_key(char* plate) {
+    unsigned long long key = 0;
+    for (int i = 0; i < 8; i++) {
+        key = (key << 8) | (unsigned char)(*plate ? *plate++ : 0);
+    }
+    return (long long)key;
+}
+
+/**
+ * Writes the rows of the chunk being filled, if any,
+ * with the smallest and largest value of each column.
+*/
+void flush_export_chunk(export_chunk_t* chunk) {
+    if (!chunk->rows) return;
+    write_le(chunk->out, chunk->rows, 4);
+    for (int c = 0; c < EXPORT_COLUMNS; c++) {
+        long long* values = chunk->values[c];
+        long long min = values[0], max = values[0];
+        for (int i = 1; i < chunk->rows; i++) {
+            if (values[i] < min) min = values[i];
+            if (values[i] > max) max = values[i];
+        }
+        fputc(c, chunk->out);
+        fputc(column_widths[c], chunk->out);
+        write_le(chunk->out, min, 8);
+        write_le(chunk->out, max, 8);
+        for (int i = 0; i < chunk->rows; i++) {
+            write_le(chunk->out, values[i], column_widths[c]);
+        }
+    }
+    chunk->total += chunk->rows;
+    chunk->rows = 0;
+}
+
+/**
+ * Adds a stay to the chunk being filled, writing it once full.
+*/
+void export_row(export_chunk_t* chunk, vehicle_t* vhc, int entry_time,
+                  int exit_time, long long cents, int park_id) {
+    chunk->values[EXPORT_PLATE][chunk->rows] = plate_key(vhc->license_plate);
+    chunk->values[EXPORT_ENTRY][chunk->rows] = entry_time;
+    chunk->values[EXPORT_EXIT][chunk->rows] = exit_time;
+    chunk->values[EXPORT_CENTS][chunk->rows] = cents;
+    chunk->values[EXPORT_PARK][chunk->rows] = park_id;
+    if (++chunk->rows == EXPORT_CHUNK_ROWS)
+        flush_export_chunk(chunk);
+}
+
+/**
+ * Adds the stays of a park that ended from one minute
+ * and before another, in exit order.
+*/
+void export_park(export_chunk_t* chunk, park_t* park, int from, int to,
+                   system_t* sys) {
+    if (park->history) {
+        history_iter_t it;
+        stay_t stay;
+        history_iter_init(&it, park->history, from);
+        while (history_iter_next(&it, &stay, sys)) {
+            if (stay.exit_time < from) continue;
+            if (stay.exit_time >= to) break;
+            export_row(chunk, stay.vehicle, stay.entry_time,
+             stay.exit_time, stay.cents, park->id);
+        }
+        return;
+    }
+    // The exits are in exit order: only the newest ones are visited
+    node_t* first = park->park_exits->tail;
+    while (first && first->prev && get_minute_index(
+        ((exit_t*)first->prev->val)->exit_date_time) >= from)
+        first = first->prev;
+    for (; first != NULL; first = first->next) {
+        exit_t* exit = (exit_t*)first->val;
+        int exit_time = get_minute_index(exit->exit_date_time);
+        if (exit_time < from) continue;
+        if (exit_time >= to) break;
+        export_row(chunk, exit->vehicle, exit->entry_time, exit_time,
+         to_cents(exit->paid_value), park->id);
+    }
+}
+
+/**
+ * Writes the stays of the given park, or of every park if none is
+ * given, that ended from one minute and before another.
+*/
+void export_stays(FILE* out, park_t* park, int from, int to,
+                    system_t* sys) {
+    export_chunk_t* chunk = (export_chunk_t*)safe_malloc(
+     sizeof(export_chunk_t));
+    chunk->out = out;
+    chunk->rows = 0;
+    chunk->total = 0;
+
+    fputs(EXPORT_MAGIC, out);
+    write_le(out, EXPORT_VERSION, 4);
+    write_le(out, EXPORT_COLUMNS, 4);
+    write_le(out, from, 4);
+    write_le(out, to, 4);
+    if (park) {
+        export_park(chunk, park, from, to, sys);
+    } else {
+        node_t* current = sys->parks->head;
+        for (; current != NULL; current = current->next) {
+            export_park(chunk, (park_t*)current->val, from, to, sys);
+        }
+    }
+    flush_export_chunk(chunk);
+    write_le(out, 0, 4);
+    write_le(out, chunk->total, 8);
+    safe_free(chunk);
+}
+
+/**
+ * Exports the stays of the given park, or of every park, that
+ * ended from the watermark up to the current minute, from a
+ * snapshot of the system. Shows the watermark of the next export.
+ * Stays ending on the current minute are left to the next export,
+ * since more of them may still come.
+*/
+void run_export(char* path, park_t* park, int from, system_t* sys) {
+    int to = get_minute_index(sys->date_registry);
+    FILE* out = fopen(path, "wb");
+
+    if (!out) {
+        printf(SNAPSHOT_NO_FILE, path);
+        return;
+    }
+    if (to < from) to = from;
+    int pid = fork_snapshot();
+    if (pid == 0) {
+        export_stays(out, park, from, to, sys);
+        _exit(fclose(out) ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    fclose(out);
+    if (pid > 0) printf(EXPORT_WATERMARK, to);
+}
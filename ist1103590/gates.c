@@ -0,0 +1,238 @@
+/**
+ * @file gates.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the concurrent ingest of gate feeds, files of
+ * movements written by the gates of the parks, one thread per feed.
+ * A lock free sequencer keeps the minute of the latest movement
+ * and only admits movements that are not earlier than it, while
+ * each movement is applied holding just the lock of its vehicle
+ * and the lock of its park, so feeds of different parks run in
+ * parallel. The vehicle table and the system totals are shared
+ * by every park and have a lock of their own, held briefly.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <pthread.h>
+
+/**
+ * Takes the lock of the state shared by every park,
+ * if gate feeds are being ingested.
+*/
+void lock_system(system_t* sys) {
+    if (sys->gates) pthread_mutex_lock(&sys->gates->system_lock);
+}
+
+/**
+ * Releases the lock taken by lock_system.
+*/
+void unlock_system(system_t* sys) {
+    if (sys->gates) pthread_mutex_unlock(&sys->gates->system_lock);
+}
+
+/**
+ * Admits a movement into the global order if it is not earlier
+ * than the latest movement admitted, making it the latest.
+ * Returns FALSE if it is earlier.
+*/
+int sequence_movement(gate_ingest_t* ingest, int minute) {
+    int last = __atomic_load_n(&ingest->last_minute, __ATOMIC_ACQUIRE);
+    do {
+        if (minute < last) return FALSE;
+    } while (!__atomic_compare_exchange_n(&ingest->last_minute, &last,
+         minute, TRUE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return TRUE;
+}
+
+/**
+ * Checks and applies a movement of a gate feed with a valid date,
+ * holding the locks of its vehicle and of its park, so the state
+ * it was checked against cannot change before it is applied.
+ * Movements are sequenced with the park locked, so each park
+ * gets them in order and they can be appended to its lists.
+ * Returns MOVEMENT_OK or the reason why it was rejected.
+*/
+int gate_movement(gate_ingest_t* ingest, bulk_record_t* rec, park_t* park) {
+    system_t* sys = ingest->sys;
+    int minute = get_minute_index(rec->date), error;
+    int is_entry = rec->op == ENTRY_COMMAND;
+    pthread_mutex_t* vehicle_lock = &ingest->vehicle_locks[
+     hash(rec->plate) & (GATE_VEHICLE_LOCKS - 1)];
+    pthread_mutex_t* park_lock = &ingest->park_locks[park->id];
+
+    pthread_mutex_lock(vehicle_lock);
+    pthread_mutex_lock(park_lock);
+    if (minute < __atomic_load_n(&ingest->last_minute, __ATOMIC_ACQUIRE)) {
+        error = MOVEMENT_INVALID_DATE;
+    } else {
+        lock_system(sys);
+        vehicle_t* vhc = search_ht(sys->vhc_ht, rec->plate);
+        unlock_system(sys);
+        error = movement_state_error(park, vhc,
+         is_license_plate(rec->plate), is_entry, sys);
+        if (error == MOVEMENT_OK && !memory_fits())
+            error = MOVEMENT_NO_MEMORY;
+        if (error == MOVEMENT_OK && !sequence_movement(ingest, minute))
+            error = MOVEMENT_INVALID_DATE;
+    }
+    if (error == MOVEMENT_OK && is_entry)
+        register_entry(park, rec->plate, rec->date, sys);
+    else if (error == MOVEMENT_OK)
+        register_exit(park, rec->plate, rec->date, sys);
+    pthread_mutex_unlock(park_lock);
+    pthread_mutex_unlock(vehicle_lock);
+    return error;
+}
+
+/**
+ * Applies a line of a gate feed, keeping it for the
+ * report if it is rejected.
+*/
+void gate_apply(gate_feed_t* feed, bulk_record_t* rec) {
+    system_t* sys = feed->ingest->sys;
+
+    if (rec->error == MOVEMENT_OK) {
+        park_t* park = lookup_park(rec->park_name, sys);
+        if (!park)
+            rec->error = BULK_NO_PARK;
+        else if (invalid_date(rec->date, sys, TRUE) ||
+            (rec->date.d == 29 && rec->date.mth == 2))
+            rec->error = MOVEMENT_INVALID_DATE;
+        else
+            rec->error = gate_movement(feed->ingest, rec, park);
+    }
+    if (rec->error == MOVEMENT_OK) {
+        feed->stats.loaded++;
+        safe_free(rec->park_name);
+        return;
+    }
+    feed->stats.rejected++;
+    if (feed->num_rejects == feed->rejects_capacity) {
+        feed->rejects_capacity = feed->rejects_capacity ?
+         2 * feed->rejects_capacity : BULK_CHUNK;
+        feed->rejects = (bulk_record_t*)safe_realloc(feed->rejects,
+         feed->rejects_capacity * sizeof(bulk_record_t));
+    }
+    feed->rejects[feed->num_rejects++] = *rec;
+}
+
+/**
+ * Main loop of the thread of a gate feed, applying its lines in order.
+*/
+void* gate_feed_loop(void* arg) {
+    gate_feed_t* feed = (gate_feed_t*)arg;
+    char* line = (char*)safe_malloc(MAX_LINE_SIZE);
+    char* name = (char*)safe_malloc(MAX_LINE_SIZE);
+    bulk_record_t rec;
+    int line_num = 0;
+
+    while (fgets(line, MAX_LINE_SIZE, feed->file)) {
+        line_num++;
+        if (is_blank_line(line)) continue;
+        read_record(&rec, line, line_num, name);
+        gate_apply(feed, &rec);
+    }
+    safe_free(line);
+    safe_free(name);
+    return NULL;
+}
+
+/**
+ * Prints the rejected lines of a gate feed and its summary,
+ * releasing them.
+*/
+void print_gate_feed(gate_feed_t* feed, system_t* sys) {
+    if (!feed->file) {
+        printf(BULK_NO_FILE, feed->path);
+        return;
+    }
+    for (int i = 0; i < feed->num_rejects; i++) {
+        bulk_record_t* rec = &feed->rejects[i];
+        park_t* park = rec->park_name ?
+         lookup_park(rec->park_name, sys) : NULL;
+        printf(BULK_REJECTED_LINE, rec->line);
+        print_bulk_error(rec, rec->error, park);
+        safe_free(rec->park_name);
+    }
+    printf(GATE_SUMMARY, feed->path, feed->stats.loaded,
+     feed->stats.rejected);
+    safe_free(feed->rejects);
+    fclose(feed->file);
+}
+
+/**
+ * Ingests several gate feeds at once, one thread per feed, then
+ * prints the rejected lines and the summary of each feed in the
+ * order they were given. Movements of different feeds are ordered
+ * as they arrive, so a movement earlier than one already applied
+ * by another feed is rejected, as a gate would be.
+ * Memory is not reclaimed while the feeds run: a movement that
+ * does not fit in the budget is rejected.
+*/
+void gate_ingest(char** paths, int num_feeds, system_t* sys) {
+    gate_ingest_t* ingest =
+     (gate_ingest_t*)safe_malloc(sizeof(gate_ingest_t));
+    gate_feed_t* feeds =
+     (gate_feed_t*)safe_malloc(num_feeds * sizeof(gate_feed_t));
+    int loaded = 0, i;
+
+    ingest->sys = sys;
+    ingest->last_minute = get_minute_index(sys->date_registry);
+    pthread_mutex_init(&ingest->system_lock, NULL);
+    for (i = 0; i < MAX_P; i++) {
+        pthread_mutex_init(&ingest->park_locks[i], NULL);
+    }
+    for (i = 0; i < GATE_VEHICLE_LOCKS; i++) {
+        pthread_mutex_init(&ingest->vehicle_locks[i], NULL);
+    }
+    sys->gates = ingest;
+    sys->bulk_loading = TRUE;
+
+    for (i = 0; i < num_feeds; i++) {
+        gate_feed_t* feed = &feeds[i];
+        memset(feed, 0, sizeof(gate_feed_t));
+        feed->path = paths[i];
+        feed->ingest = ingest;
+        feed->file = fopen(paths[i], "r");
+        // Without a thread of its own, the feed runs after the others
+        if (feed->file &&
+            pthread_create(&feed->thread, NULL, gate_feed_loop, feed))
+            feed->thread = pthread_self();
+    }
+    for (i = 0; i < num_feeds; i++) {
+        if (!feeds[i].file) continue;
+        if (pthread_equal(feeds[i].thread, pthread_self()))
+            gate_feed_loop(&feeds[i]);
+        else
+            pthread_join(feeds[i].thread, NULL);
+        loaded += feeds[i].stats.loaded;
+    }
+
+    sys->gates = NULL;
+    sys->bulk_loading = FALSE;
+    if (loaded)
+        sys->date_registry = minute_to_timestamp(ingest->last_minute);
+    for (i = 0; i < loaded; i++) {
+        retention_step(sys);
+    }
+    for (i = 0; i < num_feeds; i++) {
+        print_gate_feed(&feeds[i], sys);
+    }
+
+    pthread_mutex_destroy(&ingest->system_lock);
+    for (i = 0; i < MAX_P; i++) {
+        pthread_mutex_destroy(&ingest->park_locks[i]);
+    }
+    for (i = 0; i < GATE_VEHICLE_LOCKS; i++) {
+        pthread_mutex_destroy(&ingest->vehicle_locks[i]);
+    }
+    safe_free(feeds);
+    safe_free(ingest);
+}
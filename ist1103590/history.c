@@ -0,0 +1,288 @@
+/**
+ * @file history.c
+ * 
+ * @author Tiago Firmino - ist1103590
+ * 
+ * File containing functions used to keep the compact
+ * movement history of the parks.
+ * In compact mode a park does not keep its entries and exits
+ * in lists, every completed stay is instead appended to a block
+ * as four varints: the exit minute (as a delta from the previous
+ * exit), the length of the stay, the vehicle id and the cents paid.
+ * 
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+
+/**
+ * Creates a new empty compact history.
+*/
+history_t* init_history() {
+    int scope = mem_scope(MEM_HISTORY);
+    history_t* history = (history_t*)safe_malloc(sizeof(history_t));
+    history->capacity = HISTORY_INIT_BLOCKS;
+    history->num_blocks = 0;
+    history->first_stay = history->num_stays = 0;
+    history->horizons = NULL;
+    history->num_horizons = history->max_horizons = 0;
+    history->min_entry = INT_MAX;
+    history->blocks = (history_block_t*)safe_malloc(history->capacity *
+     sizeof(history_block_t));
+    mem_scope(scope);
+    return history;
+}
+
+/**
+ * Frees the history and its blocks.
+*/
+void free_history(history_t* history) {
+    safe_free(history->horizons);
+    safe_free(history->blocks);
+    safe_free(history);
+}
+
+/**
+ * Halves the blocks kept for the history while at most a
+ * quarter of them is in use, once old blocks were aged out.
+*/
+void shrink_history(history_t* history) {
+    int capacity = history->capacity;
+    while (capacity > HISTORY_INIT_BLOCKS &&
+        history->num_blocks <= capacity / 4) {
+        capacity /= 2;
+    }
+    if (capacity != history->capacity) {
+        history->capacity = capacity;
+        history->blocks = (history_block_t*)safe_realloc(history->blocks,
+         capacity * sizeof(history_block_t));
+    }
+}
+
+/**
+ * Appends a completed stay to the history.
+ * Stays must be appended in order of exit.
+*/
+void history_append(history_t* history, int entry_time, int exit_time,
+                      int vehicle_id, long long cents) {
+    history_block_t* block = history->num_blocks ?
+     &history->blocks[history->num_blocks - 1] : NULL;
+
+    if (!block ||
+        block->used + HISTORY_MAX_RECORD_BYTES > HISTORY_BLOCK_BYTES) {
+        if (history->num_blocks == history->capacity) {
+            history->capacity *= 2;
+            history->blocks = (history_block_t*)safe_realloc(
+             history->blocks, history->capacity * sizeof(history_block_t));
+        }
+        block = &history->blocks[history->num_blocks++];
+        block->base_exit = block->last_exit = exit_time;
+        block->count = 0;
+        block->used = 0;
+    }
+    unsigned char* data = block->data;
+    block->used += encode_varint(data + block->used,
+     (unsigned)(exit_time - block->last_exit));
+    block->used += encode_varint(data + block->used,
+     (unsigned)(exit_time - entry_time));
+    block->used += encode_varint(data + block->used, (unsigned)vehicle_id);
+    block->used += encode_varint(data + block->used, (unsigned)cents);
+    block->last_exit = exit_time;
+    block->count++;
+    history->num_stays++;
+    if (entry_time < history->min_entry)
+        history->min_entry = entry_time;
+}
+
+/**
+ * Ages out the entries before the given minute of the stays appended
+ * so far, as the lists do with every entry no longer current.
+ * Stays appended later keep theirs until the next call, even if
+ * they entered earlier, so each run of stays remembers the latest
+ * minute given after it. Older runs come first and never have an
+ * earlier minute, so only the newest runs are merged.
+ * Returns TRUE if a stay listed so far may no longer be.
+*/
+int history_age_out_entries(history_t* history, int before) {
+    int n = history->num_horizons, skip = 0, changed = FALSE;
+
+    while (skip < n && history->horizons[skip].end_stay <=
+        history->first_stay) skip++;
+    for (; n > skip && history->horizons[n - 1].before <= before; n--) {
+        if (history->horizons[n - 1].before < before) changed = TRUE;
+    }
+    n -= skip;
+    if (skip)
+        memmove(history->horizons, history->horizons + skip,
+         n * sizeof(history_horizon_t));
+    if (history->num_stays > (n ? history->horizons[n - 1].end_stay :
+        history->first_stay)) {
+        if (history->min_entry < before) changed = TRUE;
+        if (n == history->max_horizons) {
+            int scope = mem_scope(MEM_HISTORY);
+            history->max_horizons = 2 * n + 1;
+            history->horizons = (history_horizon_t*)safe_realloc(
+             history->horizons,
+             history->max_horizons * sizeof(history_horizon_t));
+            mem_scope(scope);
+        }
+        history->horizons[n].end_stay = history->num_stays;
+        history->horizons[n++].before = before;
+        history->min_entry = INT_MAX;
+    }
+    history->num_horizons = n;
+    return changed;
+}
+
+/**
+ * Starts an iterator over the stays of the history
+ * that ended at or after the given minute.
+*/
+void history_iter_init(history_iter_t* it, history_t* history, int from) {
+    int lo = 0, hi = history->num_blocks - 1;
+    it->history = history;
+    it->block = 0;
+
+    // Last block starting strictly before the minute, since stays
+    // ending on that very minute may close the previous block.
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (history->blocks[mid].base_exit < from) {
+            it->block = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    it->pos = 0;
+    it->time = history->num_blocks ? history->blocks[it->block].base_exit : 0;
+}
+
+/**
+ * Decodes the next stay of the iterator.
+ * Returns FALSE once there are no more stays.
+*/
+int history_iter_next(history_iter_t* it, stay_t* stay, system_t* sys) {
+    unsigned exit_delta, length, vehicle_id, cents;
+
+    while (it->block < it->history->num_blocks &&
+        it->pos >= it->history->blocks[it->block].used) {
+        it->block++;
+        it->pos = 0;
+        if (it->block < it->history->num_blocks)
+            it->time = it->history->blocks[it->block].base_exit;
+    }
+    if (it->block >= it->history->num_blocks) return FALSE;
+
+    unsigned char* data = it->history->blocks[it->block].data;
+    it->pos += decode_varint(data + it->pos, &exit_delta);
+    it->pos += decode_varint(data + it->pos, &length);
+    it->pos += decode_varint(data + it->pos, &vehicle_id);
+    it->pos += decode_varint(data + it->pos, &cents);
+
+    it->time += exit_delta;
+    stay->exit_time = it->time;
+    stay->entry_time = it->time - (int)length;
+    stay->vehicle = sys->vehicle_ids[vehicle_id];
+    stay->cents = cents;
+    return TRUE;
+}
+
+/**
+ * Shows the facturation of a park with compact history
+ * on a given day, sorted by the exit date and time.
+*/
+void print_history_facturation_by_day(park_t* park,
+            timestamp_t facturation_date, system_t* sys) {
+    history_iter_t it;
+    stay_t stay;
+    int day_start = get_minute_index(facturation_date);
+
+    history_iter_init(&it, park->history, day_start);
+    while (history_iter_next(&it, &stay, sys)) {
+        if (stay.exit_time < day_start) continue;
+        if (stay.exit_time >= day_start + MINS_IN_DAY) break;
+        printf("%s %02d:%02d %lld.%02lld\n", stay.vehicle->license_plate,
+         (stay.exit_time % MINS_IN_DAY) / 60, stay.exit_time % 60,
+         stay.cents / 100, stay.cents % 100);
+    }
+}
+
+/**
+ * Shows the daily facturation of a park with compact history
+ * since its creation, sorted by date, starting with the days
+ * that were aged out.
+*/
+void print_history_facturation(park_t* park, system_t* sys) {
+    history_iter_t it;
+    stay_t stay;
+    int day = INVALID;
+    long long daily_cents = 0;
+
+    history_iter_init(&it, park->history, 0);
+    while (history_iter_next(&it, &stay, sys)) {
+        if (stay.exit_time / MINS_IN_DAY != day) {
+            if (day != INVALID) {
+                print_daily_cents(day, daily_cents);
+                daily_cents = 0;
+            } else {
+                daily_cents = print_day_totals(park,
+                 stay.exit_time / MINS_IN_DAY);
+            }
+            day = stay.exit_time / MINS_IN_DAY;
+        }
+        daily_cents += stay.cents;
+    }
+    if (day != INVALID)
+        print_daily_cents(day, daily_cents);
+    else
+        print_day_totals(park, INT_MAX);
+}
+
+/**
+ * Prints the total of a day of facturation.
+*/
+void print_daily_cents(int day, long long cents) {
+    timestamp_t date = minute_to_timestamp(day * MINS_IN_DAY);
+    printf("%02d-%02d-%4d %lld.%02lld\n", date.d, date.mth, date.y,
+     cents / 100, cents % 100);
+}
+
+/**
+ * Lists the stays of a vehicle in a park with compact history
+ * whose entry was not aged out, including its current stay
+ * if it is still inside.
+ * Returns the number of listed stays.
+*/
+int log_vehicle_history_in_park(vehicle_t* vhc, park_t* park,
+                                  system_t* sys) {
+    history_t* history = park->history;
+    history_iter_t it;
+    stay_t stay;
+    int activity_count = 0, index = history->first_stay, horizon = 0;
+
+    history_iter_init(&it, history, 0);
+    for (; history_iter_next(&it, &stay, sys); index++) {
+        while (horizon < history->num_horizons &&
+            history->horizons[horizon].end_stay <= index) horizon++;
+        if (stay.vehicle != vhc || (horizon < history->num_horizons &&
+            stay.entry_time < history->horizons[horizon].before)) continue;
+        timestamp_t entry = minute_to_timestamp(stay.entry_time);
+        timestamp_t exit = minute_to_timestamp(stay.exit_time);
+        printf("%s %02d-%02d-%4d %02d:%02d %02d-%02d-%4d %02d:%02d\n",
+         park->park_name, entry.d, entry.mth, entry.y, entry.h, entry.min,
+         exit.d, exit.mth, exit.y, exit.h, exit.min);
+        activity_count++;
+    }
+    if (vhc->current_entry && vhc->current_entry->park_id == park->id) {
+        print_entries(vhc->current_entry, park);
+        printf("\n");
+        activity_count++;
+    }
+    return activity_count;
+}
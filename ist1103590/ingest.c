@@ -0,0 +1,238 @@
+/**
+ * @file ingest.c
+ * 
+ * @author Tiago Firmino - ist1103590
+ * 
+ * File containing functions used to load movements in bulk.
+ * A file of 'e' and 's' lines, or the merge of several, is read
+ * in chunks. The checks that
+ * do not depend on the state of the system (license plate and
+ * calendar date) run first over the whole chunk, then every line
+ * is applied in order without printing, and only the rejected
+ * lines are reported.
+ * 
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/**
+ * Parses a park name from a line the same way read_name does
+ * from stdin, either quoted or up to the next space.
+ * Returns a pointer past the name, or NULL if it is invalid.
+*/
+char* parse_line_name(char* s, char* name) {
+    int i = 0;
+    if (*s == '"') {
+        for (s++; *s && *s != '"'; s++) {
+            if (is_digit(*s)) return NULL;
+            name[i++] = *s;
+        }
+        if (*s != '"') return NULL;
+        s++;
+    } else {
+        for (; *s && *s != ' ' && *s != '\t' && *s != '\n'; s++) {
+            if (is_digit(*s)) return NULL;
+            name[i++] = *s;
+        }
+    }
+    name[i] = '\0';
+    return i ? s : NULL;
+}
+
+/**
+ * Parses a movement line into a record, using name as
+ * scratch space for the park name.
+ * Returns MOVEMENT_OK, or the reason why the line
+ * could not even be parsed.
+*/
+int parse_movement_line(char* line, char* name, bulk_record_t* rec) {
+    char* s = line;
+    while (*s == ' ' || *s == '\t') s++;
+    rec->op = *s;
+    if ((rec->op != ENTRY_COMMAND && rec->op != EXIT_COMMAND) ||
+        (s[1] != ' ' && s[1] != '\t'))
+        return BULK_INVALID_LINE;
+
+    for (s++; *s == ' ' || *s == '\t'; s++);
+    s = parse_line_name(s, name);
+    if (!s) return BULK_INVALID_NAME;
+    rec->park_name = duplicate_string(name);
+
+    if (sscanf(s, "%15s %02d-%02d-%4d %02d:%02d", rec->plate,
+         &rec->date.d, &rec->date.mth, &rec->date.y,
+         &rec->date.h, &rec->date.min) != 6)
+        return MOVEMENT_INVALID_DATE;
+    return MOVEMENT_OK;
+}
+
+/**
+ * Checks whether a line of a file has nothing but spaces.
+*/
+int is_blank_line(char* line) {
+    return line[strspn(line, " \t\r\n")] == '\0';
+}
+
+/**
+ * Fills a record with the movement of the given line of a file.
+*/
+void read_record(bulk_record_t* rec, char* line, int line_num, char* name) {
+    rec->line = line_num;
+    rec->plate[0] = '\0';
+    rec->park_name = NULL;
+    rec->source = NULL;
+    memset(&rec->date, 0, sizeof(timestamp_t));
+    rec->error = parse_movement_line(line, name, rec);
+}
+
+/**
+ * Runs the checks of a chunk of records that do not depend on the
+ * state of the system, as independent loops over the whole chunk.
+*/
+void bulk_precheck(bulk_chunk_t* chunk, system_t* sys) {
+    int i, n = chunk->size;
+    bulk_record_t* recs = chunk->recs;
+
+    for (i = 0; i < n; i++) {
+        chunk->valid_plate[i] = (char)is_license_plate(recs[i].plate);
+    }
+    for (i = 0; i < n; i++) {
+        chunk->valid_date[i] = (char)(!invalid_date(recs[i].date, sys, TRUE)
+         && !(recs[i].date.d == 29 && recs[i].date.mth == 2));
+    }
+    for (i = 0; i < n; i++) {
+        chunk->mins[i] = get_time_in_mins(recs[i].date);
+    }
+}
+
+/**
+ * Looks up the vehicles of every record of a chunk with one
+ * batched search of the vehicle hash table.
+ * Vehicles are never removed while loading, so a vehicle found
+ * here is still valid when its line is applied; a plate not found
+ * may still be added by an earlier line of the same chunk, so
+ * bulk_apply searches those again.
+*/
+void bulk_resolve(bulk_chunk_t* chunk, system_t* sys) {
+    for (int i = 0; i < chunk->size; i++) {
+        chunk->plates[i] = chunk->recs[i].plate;
+    }
+    search_ht_batch(sys->vhc_ht, chunk->plates, chunk->size,
+     chunk->vehicles);
+}
+
+/**
+ * Applies a chunk of records in order, as the 'e' and 's' commands
+ * would, printing only the lines that are rejected.
+*/
+void bulk_apply(bulk_chunk_t* chunk, bulk_stats_t* stats, system_t* sys) {
+    for (int i = 0; i < chunk->size; i++) {
+        bulk_record_t* rec = &chunk->recs[i];
+        int error = rec->error, is_entry = rec->op == ENTRY_COMMAND;
+        park_t* park = NULL;
+        vehicle_t* vhc = chunk->vehicles[i];
+
+        if (error == MOVEMENT_OK) {
+            park = lookup_park(rec->park_name, sys);
+            if (!park)
+                error = BULK_NO_PARK;
+            else if (!chunk->valid_date[i] ||
+                chunk->mins[i] < get_time_in_mins(sys->date_registry))
+                error = MOVEMENT_INVALID_DATE;
+            else {
+                if (!vhc) vhc = search_ht(sys->vhc_ht, rec->plate);
+                error = movement_state_error(park, vhc,
+                 chunk->valid_plate[i], is_entry, sys);
+                if (error == MOVEMENT_OK && !memory_admits(sys))
+                    error = MOVEMENT_NO_MEMORY;
+            }
+        }
+        if (error == MOVEMENT_OK) {
+            if (is_entry)
+                register_entry(park, rec->plate, rec->date, sys);
+            else
+                register_exit(park, rec->plate, rec->date, sys);
+            retention_step(sys);
+            stats->loaded++;
+            continue;
+        }
+
+        stats->rejected++;
+        if (rec->source) printf(MERGE_SOURCE, rec->source);
+        printf(BULK_REJECTED_LINE, rec->line);
+        print_bulk_error(rec, error, park);
+    }
+    for (int i = 0; i < chunk->size; i++) {
+        safe_free(chunk->recs[i].park_name);
+    }
+}
+
+/**
+ * Prints why a line of a file was rejected.
+*/
+void print_bulk_error(bulk_record_t* rec, int error, park_t* park) {
+    if (error == BULK_INVALID_LINE)
+        printf(BULK_INVALID_MOVEMENT);
+    else if (error == BULK_INVALID_NAME)
+        printf(PARK_INVALID_NAME);
+    else if (error == BULK_NO_PARK)
+        printf(PARK_DOESNT_EXIST, rec->park_name);
+    else
+        print_movement_error(error, park, rec->plate);
+}
+
+/**
+ * Loads every movement of a file into the system, leaving it
+ * in the same state as typing the lines one by one would.
+ * Several files are merged by the minute of their lines first,
+ * and their rejected lines show the file they came from.
+ * Prints the rejected lines and a summary.
+*/
+void bulk_load(char** paths, int num_paths, system_t* sys) {
+    merge_t* merge = merge_open(paths, num_paths);
+    bulk_stats_t stats = {0, 0};
+    merge_feed_t* feed;
+
+    if (!merge) return;
+    bulk_chunk_t* chunk = (bulk_chunk_t*)safe_malloc(sizeof(bulk_chunk_t));
+    sys->bulk_loading = TRUE;
+
+    do {
+        chunk->size = 0;
+        while (chunk->size < BULK_CHUNK && (feed = merge_next(merge))) {
+            chunk->recs[chunk->size++] = feed->rec;
+            feed->rec.park_name = NULL;
+        }
+        bulk_precheck(chunk, sys);
+        bulk_resolve(chunk, sys);
+        bulk_apply(chunk, &stats, sys);
+    } while (chunk->size == BULK_CHUNK);
+
+    sys->bulk_loading = FALSE;
+    printf(BULK_SUMMARY, stats.loaded, stats.rejected);
+    safe_free(chunk);
+    merge_close(merge);
+}
+
+/**
+ * Loads a single line of a file, as bulk_load would.
+ * Used by the workers of the router mode, which are given
+ * the lines of a bulk load one at a time.
+*/
+void bulk_line(bulk_chunk_t* chunk, char* line, int line_num,
+                bulk_stats_t* stats, system_t* sys) {
+    char* name = (char*)safe_malloc(MAX_LINE_SIZE);
+
+    chunk->size = 1;
+    read_record(&chunk->recs[0], line, line_num, name);
+    sys->bulk_loading = TRUE;
+    bulk_precheck(chunk, sys);
+    bulk_resolve(chunk, sys);
+    bulk_apply(chunk, stats, sys);
+    sys->bulk_loading = FALSE;
+    safe_free(name);
+}
@@ -0,0 +1,172 @@
+/**
+ * @file memory.c
+ * 
+ * @author Tiago Firmino - ist1103590
+ * 
+ * File containing the allocator used by the whole program.
+ * Every allocation carries a small header with its size and
+ * the subsystem it is charged to, so the memory in use can be
+ * reported per subsystem and kept within a budget. When the
+ * budget runs out, old movements are aged out to make room, and
+ * only the command that still does not fit is rejected.
+ * The counters are updated atomically, since gate feeds can be
+ * ingested by several threads at once.
+ * 
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/* the allocator has no access to the system, so it keeps its own state */
+static mem_account_t account = {{0}, 0, 0, 0, 0};
+
+/* subsystem charged for new allocations, each thread sets its own */
+static _Thread_local int scope = MEM_OTHER;
+
+static const char* mem_names[MEM_SUBSYSTEMS] = {
+    "vehicles", "entries", "exits", "parks", "history", "other", "cache",
+    "alerts"
+};
+
+/**
+ * Sets the subsystem charged for the allocations that follow.
+ * Returns the previous one, which the caller restores when done.
+*/
+int mem_scope(int tag) {
+    int previous = scope;
+    scope = tag;
+    return previous;
+}
+
+/**
+ * Adds (or with a negative value, removes) bytes
+ * to the memory in use by a subsystem.
+*/
+void mem_charge(int tag, long long bytes) {
+    __atomic_add_fetch(&account.used[tag], bytes, __ATOMIC_RELAXED);
+    if (bytes <= 0) return;
+
+    long long total = mem_total();
+    long long peak = __atomic_load_n(&account.peak, __ATOMIC_RELAXED);
+    while (total > peak && !__atomic_compare_exchange_n(&account.peak,
+         &peak, total, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * A safe version of malloc that stops the program if no memory
+ * is available. The memory is charged to the current subsystem.
+ */
+void *safe_malloc(unsigned size) {
+    mem_header_t* header =
+     (mem_header_t*)malloc(sizeof(mem_header_t) + size);
+    if (!header) {
+        printf("No memory.");
+        exit(EXIT_FAILURE);
+    }
+    header->info.size = size;
+    header->info.tag = scope;
+    __atomic_add_fetch(&account.allocations, 1, __ATOMIC_RELAXED);
+    mem_charge(header->info.tag, sizeof(mem_header_t) + size);
+    return header + 1;
+}
+
+/**
+ * A safe version of realloc that stops the program if no memory
+ * is available. The memory stays charged to the subsystem of
+ * the original allocation.
+ */
+void *safe_realloc(void* ptr, unsigned size) {
+    if (!ptr) return safe_malloc(size);
+
+    mem_header_t* header = (mem_header_t*)ptr - 1;
+    long long old_size = header->info.size;
+    header = (mem_header_t*)realloc(header, sizeof(mem_header_t) + size);
+    if (!header) {
+        printf("No memory.");
+        exit(EXIT_FAILURE);
+    }
+    header->info.size = size;
+    __atomic_add_fetch(&account.allocations, 1, __ATOMIC_RELAXED);
+    mem_charge(header->info.tag, (long long)size - old_size);
+    return header + 1;
+}
+
+/**
+ * Frees memory given by safe_malloc or safe_realloc,
+ * discharging it from its subsystem.
+ */
+void safe_free(void* ptr) {
+    if (!ptr) return;
+    mem_header_t* header = (mem_header_t*)ptr - 1;
+    mem_charge(header->info.tag,
+     -(long long)(sizeof(mem_header_t) + header->info.size));
+    free(header);
+}
+
+/**
+ * Returns the memory in use by the whole program.
+*/
+long long mem_total() {
+    long long total = 0;
+    for (int i = 0; i < MEM_SUBSYSTEMS; i++) {
+        total += __atomic_load_n(&account.used[i], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+/**
+ * Returns the number of allocations made so far, counting
+ * every call to safe_malloc and safe_realloc.
+*/
+long long mem_allocations() {
+    return __atomic_load_n(&account.allocations, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sets the memory budget in bytes, 0 meaning no budget.
+*/
+void set_mem_budget(long long bytes) {
+    account.budget = bytes;
+}
+
+/**
+ * Checks whether there is room in the budget for one more
+ * command, without making any.
+*/
+int memory_fits() {
+    return !account.budget || mem_total() + MEMORY_RESERVE <= account.budget;
+}
+
+/**
+ * Checks whether there is room in the budget for one more
+ * command. If there is not, every movement before the current
+ * day is aged out first, regardless of the retention period,
+ * and the budget checked again.
+*/
+int memory_admits(system_t* sys) {
+    if (memory_fits()) return TRUE;
+
+    long long before = mem_total();
+    reclaim_cold_history(sys);
+    account.reclaimed += before - mem_total();
+    return memory_fits();
+}
+
+/**
+ * Prints the memory in use by each subsystem, followed by
+ * the total, its peak, the budget and how much was reclaimed
+ * to stay within it.
+*/
+void print_memory_report() {
+    for (int i = 0; i < MEM_SUBSYSTEMS; i++) {
+        printf("%s %lld\n", mem_names[i], account.used[i]);
+    }
+    printf("total %lld\n", mem_total());
+    printf("peak %lld\n", account.peak);
+    printf("budget %lld\n", account.budget);
+    printf("reclaimed %lld\n", account.reclaimed);
+}
@@ -0,0 +1,148 @@
+/**
+ * @file merge.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the merge of several files of movements, such
+ * as the ones written by the gates of each park, each in its own
+ * order. Every file is read in blocks and only its next line is
+ * kept, in a binary heap ordered by the minute of the line, so the
+ * lines come out in the global order the system expects with the
+ * same memory however long the files are.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+/**
+ * Reads the next line of a file being merged, skipping blank
+ * lines. A line without a valid date keeps the minute of the line
+ * before it, so it comes out right after it.
+ * Returns FALSE at the end of the file.
+*/
+int merge_read(merge_feed_t* feed, merge_t* merge) {
+    safe_free(feed->rec.park_name);
+    feed->rec.park_name = NULL;
+    do {
+        if (!fgets(feed->line, MAX_LINE_SIZE, feed->file)) return FALSE;
+        feed->line_num++;
+    } while (is_blank_line(feed->line));
+
+    read_record(&feed->rec, feed->line, feed->line_num, merge->name);
+    feed->rec.source = merge->num_feeds > 1 ? feed->path : NULL;
+    // Only the calendar is checked, which needs no system
+    if (feed->rec.error == MOVEMENT_OK &&
+        !invalid_date(feed->rec.date, NULL, TRUE))
+        feed->key = get_time_in_mins(feed->rec.date);
+    return TRUE;
+}
+
+/**
+ * Checks whether the next line of one file comes before that of
+ * another: by minute, then by the order the files were given in.
+*/
+int merge_before(merge_t* merge, int a, int b) {
+    merge_feed_t* feed_a = &merge->feeds[a];
+    merge_feed_t* feed_b = &merge->feeds[b];
+    if (feed_a->key != feed_b->key) return feed_a->key < feed_b->key;
+    return a < b;
+}
+
+/**
+ * Moves the file at a position of the heap down to its place.
+*/
+void merge_sift_down(merge_t* merge, int pos) {
+    int* heap = merge->heap;
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= merge->size) return;
+        if (child + 1 < merge->size &&
+            merge_before(merge, heap[child + 1], heap[child]))
+            child++;
+        if (!merge_before(merge, heap[child], heap[pos])) return;
+        int tmp = heap[pos];
+        heap[pos] = heap[child];
+        heap[child] = tmp;
+        pos = child;
+    }
+}
+
+/**
+ * Opens the files to merge and reads their first lines, printing
+ * the ones that cannot be opened. Returns the merge, or NULL if
+ * no file could be opened.
+*/
+merge_t* merge_open(char** paths, int num_paths) {
+    merge_t* merge = (merge_t*)safe_malloc(sizeof(merge_t));
+    merge->num_feeds = 0;
+    merge->size = 0;
+    merge->last = INVALID;
+    merge->name = (char*)safe_malloc(MAX_LINE_SIZE);
+
+    for (int i = 0; i < num_paths; i++) {
+        FILE* file = fopen(paths[i], "r");
+        if (!file) {
+            printf(BULK_NO_FILE, paths[i]);
+            continue;
+        }
+        merge_feed_t* feed = &merge->feeds[merge->num_feeds++];
+        feed->path = paths[i];
+        feed->file = file;
+        feed->block = (char*)safe_malloc(MERGE_BLOCK);
+        setvbuf(file, feed->block, _IOFBF, MERGE_BLOCK);
+        feed->line = (char*)safe_malloc(MAX_LINE_SIZE);
+        feed->line_num = 0;
+        feed->key = INT_MIN;
+        feed->rec.park_name = NULL;
+    }
+    if (!merge->num_feeds) {
+        merge_close(merge);
+        return NULL;
+    }
+    for (int i = 0; i < merge->num_feeds; i++) {
+        if (merge_read(&merge->feeds[i], merge))
+            merge->heap[merge->size++] = i;
+    }
+    for (int pos = merge->size / 2 - 1; pos >= 0; pos--) {
+        merge_sift_down(merge, pos);
+    }
+    return merge;
+}
+
+/**
+ * Returns the file with the next line of the merge, after moving
+ * past the line returned before, or NULL once every line is out.
+*/
+merge_feed_t* merge_next(merge_t* merge) {
+    if (merge->last != INVALID) {
+        if (!merge_read(&merge->feeds[merge->last], merge))
+            merge->heap[0] = merge->heap[--merge->size];
+        merge_sift_down(merge, 0);
+    }
+    if (!merge->size) {
+        merge->last = INVALID;
+        return NULL;
+    }
+    merge->last = merge->heap[0];
+    return &merge->feeds[merge->last];
+}
+
+/**
+ * Closes the files of a merge and frees it.
+*/
+void merge_close(merge_t* merge) {
+    for (int i = 0; i < merge->num_feeds; i++) {
+        merge_feed_t* feed = &merge->feeds[i];
+        fclose(feed->file);
+        safe_free(feed->rec.park_name);
+        safe_free(feed->line);
+        safe_free(feed->block);
+    }
+    safe_free(merge->name);
+    safe_free(merge);
+}
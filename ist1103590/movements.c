@@ -16,6 +16,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 
 
 /**
@@ -26,16 +27,23 @@
  * If the given vehicle is new, add it to the system's
  * vehicle hash table and the park's vehicle list,
  * incrementing the number of vehicles of that park.
+ * Parks with compact history only keep the entry
+ * as the vehicle's current entry until it leaves.
+ * The vehicle table and the system are shared by every park,
+ * so they are locked while gate feeds are ingested.
  * Prints the park where the entry was made and the
- * available park slots.
+ * available park slots, unless bulk loading, in which case the
+ * entry (already known to be the latest) goes to the end of the list.
 */
 void register_entry(park_t* park,
                 char* license_plate, 
                 timestamp_t entry_d,
                 system_t* sys) {
 
+    int scope = mem_scope(MEM_ENTRIES);
     entry_t* new_entry = (entry_t*)safe_malloc(sizeof(entry_t));
 
+    lock_system(sys);
     vehicle_t* vhc = search_ht(sys->vhc_ht, license_plate);
     if (vhc == NULL)
         vhc = add_vehicle(license_plate, new_entry, entry_d, sys);
@@ -43,30 +51,47 @@ void register_entry(park_t* park,
         vhc->last_entry = entry_d;
         vhc->current_entry = new_entry;
     }
+    sys->date_registry = entry_d;
+    sys->num_movements++;
+    advance_alerts(sys->alerts, get_minute_index(entry_d));
+    arm_alert(sys->alerts, vhc, park, get_minute_index(entry_d));
+    unlock_system(sys);
+
     new_entry->vehicle = vhc;
     strcpy(new_entry->vehicle->license_plate, license_plate);
-    new_entry->park_name = park->park_name;
+    new_entry->park_id = park->id;
     new_entry->entry_date_time = entry_d;
-
-    sys->date_registry = entry_d;
+    new_entry->open_node = NULL;
     
     park->num_vehicles++;
-    insert_list(park->park_vehicles, vhc);
+    park->version++;
+    vhc->version++;
+    vhc->park_node = insert_list(park->park_vehicles, vhc);
+    series_append(park->occupancy, get_minute_index(entry_d),
+     park->num_vehicles);
+    count_visitor(park->visitors, get_day_index(entry_d), license_plate);
+    publish_occupancy(sys->events, park);
     
-    sorted_insert_list(park->park_entries, new_entry, ENTRY_COMMAND);
-
-    printf("%s %d\n", park->park_name,
-     park->park_capacity - park->num_vehicles);
+    if (!park->history && sys->bulk_loading)
+        insert_list(park->park_entries, new_entry);
+    else if (!park->history)
+        sorted_insert_list(park->park_entries, new_entry, ENTRY_COMMAND);
+
+    mem_scope(scope);
+    if (!sys->bulk_loading)
+        printf("%s %d\n", park->park_name,
+         park->park_capacity - park->num_vehicles);
     
 }
 
 /**
  * Creates a new exit initializing its values
  * and inserts it into the park's exits list
- * sorted by exit date.
+ * sorted by exit date, or appends the whole stay to the
+ * park's compact history if it has one.
  * Sets the vehicle's current entry to NULL
  * and decreases the number of vehicles in that park,
- * deleting that vehicle node from the park's vehicle list.
+ * unlinking the vehicle's own node from the park's vehicle list.
  * Calculates the total facturation for the
  * period in which the vehicle stayed inside the park.
 */
@@ -75,114 +100,158 @@ void register_exit(park_t* park,
                 timestamp_t exit_d,
                 system_t* sys) {
     
-    exit_t* new_exit = (exit_t*)safe_malloc(sizeof(exit_t));
+    int scope = mem_scope(MEM_EXITS);
 
+    lock_system(sys);
     vehicle_t* vhc = search_ht(sys->vhc_ht, license_plate);
-    vhc->current_entry = NULL;
-
-    new_exit->park_name = park->park_name;
-    new_exit->vehicle = vhc;
-    strcpy(new_exit->vehicle->license_plate, license_plate);
-    new_exit->exit_date_time = exit_d;
-
     sys->date_registry = exit_d;
+    sys->num_movements++;
+    cancel_alert(sys->alerts, vhc);
+    advance_alerts(sys->alerts, get_minute_index(exit_d));
+    unlock_system(sys);
 
     float paid_value = calculate_facturation(vhc->last_entry,
      exit_d, park->park_tariff);
-    new_exit->paid_value = paid_value;
+    index_revenue(park, exit_d, to_cents(paid_value), sys);
+    count_duration(park->durations, get_day_index(exit_d),
+     get_minute_index(exit_d) - get_minute_index(vhc->last_entry));
+    index_stay(park->stays, get_minute_index(vhc->last_entry),
+     get_minute_index(exit_d), vhc->id);
+    rank_exit(vhc, park, to_cents(paid_value), sys);
+
+    if (park->history) {
+        history_append(park->history, get_minute_index(vhc->last_entry),
+         get_minute_index(exit_d), vhc->id, to_cents(paid_value));
+        safe_free(vhc->current_entry);
+    } else {
+        exit_t* new_exit = (exit_t*)safe_malloc(sizeof(exit_t));
+        new_exit->park_id = park->id;
+        new_exit->entry_time = get_minute_index(vhc->last_entry);
+        new_exit->vehicle = vhc;
+        new_exit->exit_date_time = exit_d;
+        new_exit->paid_value = paid_value;
+        if (sys->bulk_loading)
+            insert_list(park->park_exits, new_exit);
+        else
+            sorted_insert_list(park->park_exits, new_exit, EXIT_COMMAND);
+        // An entry aged out while parked goes back in front of the
+        // entries once its stay is over, for the next step to release
+        if (vhc->current_entry->open_node) {
+            unlink_node(park->open_entries, vhc->current_entry->open_node);
+            vhc->current_entry->open_node = NULL;
+            sorted_insert_list(park->park_entries, vhc->current_entry,
+             ENTRY_COMMAND);
+        }
+    }
+    vhc->current_entry = NULL;
+    vhc->version++;
 
     park->num_vehicles--;
-    delete_node(park->park_vehicles, vhc);
-
-    sorted_insert_list(park->park_exits, new_exit, EXIT_COMMAND);
-
+    park->version++;
+    unlink_node(park->park_vehicles, vhc->park_node);
+    vhc->park_node = NULL;
+    series_append(park->occupancy, get_minute_index(exit_d),
+     park->num_vehicles);
+    publish_occupancy(sys->events, park);
+    mem_scope(scope);
+
+    if (sys->bulk_loading) return;
     printf("%s %02d-%02d-%4d %02d:%02d %02d-%02d-%4d %02d:%02d %.2f\n",
         license_plate, vhc->last_entry.d,
          vhc->last_entry.mth, vhc->last_entry.y,
          vhc->last_entry.h, vhc->last_entry.min, 
          exit_d.d, exit_d.mth, exit_d.y,
-         exit_d.h, exit_d.min, new_exit->paid_value);
+         exit_d.h, exit_d.min, paid_value);
 }
 
 
 /**
- * Checks for invalid arguments of the commands 'e' and 's'.
+ * Checks for invalid arguments of the commands 'e' and 's',
+ * printing the corresponding error.
 */
 int invalid_movement_args(park_t* park, char* license_plate,
  timestamp_t date, system_t* sys, int is_entry) {
-    vehicle_t* vhc = search_ht(sys->vhc_ht, license_plate);
-
-    if (validate_movement_date(date, sys)) return TRUE;
-    if (validate_entry_park_capacity(park, is_entry)) return TRUE;
-    if (validate_license_plate(license_plate)) return TRUE;
-    if (validate_vehicle_entry(vhc, is_entry)) return TRUE;
-    if (validate_vehicle_exit(vhc, is_entry, park, license_plate)) return TRUE;
-
-    return FALSE;
+    int error = movement_error(park, license_plate, date, sys, is_entry);
+    print_movement_error(error, park, license_plate);
+    return error != MOVEMENT_OK;
 }
 
 /**
- * Checks if the given date is invalid 
- * or if the day of date is the 29th of february.
+ * Returns the first reason why a movement is invalid,
+ * or MOVEMENT_OK if it is valid. Does not print anything.
+ * Invalid dates, including the 29th of february,
+ * and dates before the last movement come first, and a valid
+ * movement that does not fit in the memory budget comes last.
 */
-int validate_movement_date(timestamp_t date, system_t* sys) {
+int movement_error(park_t* park, char* license_plate,
+ timestamp_t date, system_t* sys, int is_entry) {
     if (invalid_date(date, sys, FALSE) ||
         (date.d == 29 && date.mth == 2)) {
-        printf(INVALID_DATE);
-        return TRUE;
+        return MOVEMENT_INVALID_DATE;
     }
-    return FALSE;
+    int error = movement_state_error(park,
+     search_ht(sys->vhc_ht, license_plate),
+     is_license_plate(license_plate), is_entry, sys);
+    if (error == MOVEMENT_OK && !memory_admits(sys))
+        return MOVEMENT_NO_MEMORY;
+    return error;
 }
 
 /**
- * Checks in case of an entry if the park capacity
- * has already been exceeded.
+ * Returns the first reason why a movement with a valid date
+ * is invalid: the park being full on an entry, the license plate,
+ * the vehicle already being in a park on an entry (possibly one
+ * of another worker, in router mode), or on an exit the vehicle
+ * not being in the given park.
 */
-int validate_entry_park_capacity(park_t* park, int is_entry) {
-    if (is_entry && park->num_vehicles == park->park_capacity) {
-        printf(PARK_CAPACITY_EXCEEDED, park->park_name);
-        return TRUE;
-    }
-    return FALSE;
+int movement_state_error(park_t* park, vehicle_t* vhc,
+ int valid_plate, int is_entry, system_t* sys) {
+    if (is_entry && park->num_vehicles == park->park_capacity)
+        return MOVEMENT_PARK_FULL;
+    if (!valid_plate)
+        return MOVEMENT_INVALID_PLATE;
+    if (is_entry && ((vhc && vhc->current_entry) || sys->entry_elsewhere))
+        return MOVEMENT_INVALID_ENTRY;
+    if (!is_entry && (!vhc || !vhc->current_entry ||
+        vhc->current_entry->park_id != park->id))
+        return MOVEMENT_INVALID_EXIT;
+    return MOVEMENT_OK;
 }
 
 /**
- * Checks if the given license plate is valid.
+ * Prints the message of a movement error.
 */
-int validate_license_plate(char* license_plate) {
-    if (!is_license_plate(license_plate)) {
-        printf(VEHICLE_INVALID_LICENSE, license_plate);
-        return TRUE;
-    }
-    return FALSE;
-}
-
-/**
- * Checks in case of an entry, if the given vehicle
- * has already made an entry.
-*/
-int validate_vehicle_entry(vehicle_t* vhc, int is_entry) {
-    if (is_entry && vhc && vhc->current_entry) {
-        printf(VEHICLE_INVALID_ENTRY, vhc->license_plate);
-        return TRUE;
+void print_movement_error(int error, park_t* park, char* license_plate) {
+    switch (error) {
+        case MOVEMENT_INVALID_DATE:
+            printf(INVALID_DATE);
+            break;
+        case MOVEMENT_PARK_FULL:
+            printf(PARK_CAPACITY_EXCEEDED, park->park_name);
+            break;
+        case MOVEMENT_INVALID_PLATE:
+            printf(VEHICLE_INVALID_LICENSE, license_plate);
+            break;
+        case MOVEMENT_INVALID_ENTRY:
+            printf(VEHICLE_INVALID_ENTRY, license_plate);
+            break;
+        case MOVEMENT_INVALID_EXIT:
+            printf(VEHICLE_INVALID_EXIT, license_plate);
+            break;
+        case MOVEMENT_NO_MEMORY:
+            printf(MEMORY_BUDGET_EXCEEDED);
+            break;
+        default:
+            break;
     }
-    return FALSE;
 }
 
 /**
- * Checks in case of an exit, if the vehicle exists,
- * if the vehicle made an entry on the given park that it is
- * trying to exit and if the vehicle is not currently
- * in a park.
+ * Checks if the given license plate is valid.
 */
-int validate_vehicle_exit(vehicle_t* vhc, int is_entry,
- park_t* park, char* license_plate) {
-    if ((!is_entry && !vhc) || 
-        (!is_entry && vhc && vhc->current_entry && 
-        strcmp(vhc->current_entry->park_name,
-         park->park_name) != 0) || 
-        (!is_entry && vhc && !vhc->current_entry)) {
-        printf(VEHICLE_INVALID_EXIT, license_plate);
+int validate_license_plate(char* license_plate) {
+    if (!is_license_plate(license_plate)) {
+        printf(VEHICLE_INVALID_LICENSE, license_plate);
         return TRUE;
     }
     return FALSE;
@@ -285,35 +354,112 @@ void print_facturation_by_day(park_t* park,
 }
 
 
+/**
+ * Warns that the movements of a given day were aged out
+ * of the park's history, if they were.
+ * Returns TRUE in that case, FALSE otherwise.
+*/
+int print_aged_out_day(park_t* park, timestamp_t facturation_date) {
+    if (!day_aged_out(park, get_day_index(facturation_date)))
+        return FALSE;
+    printf(FACT_AGED_OUT, facturation_date.d, facturation_date.mth,
+     facturation_date.y);
+    return TRUE;
+}
+
 /**
  * Shows the daily facturation of a given park since its creation,
- * sorted by date.
+ * sorted by date, starting with the days that were aged out.
+ * Days are summed in cents, as the aged out totals are, so a day
+ * shows the same value before and after it is aged out.
 */
 void print_facturation(park_t* park) {
 
     node_t* current_node = park->park_exits->head;
-    if (current_node == NULL) return;
+    if (current_node == NULL) {
+        print_day_totals(park, INT_MAX);
+        return;
+    }
 
     exit_t* exit = (exit_t*)current_node->val;
-    timestamp_t previous_date = exit->exit_date_time;
-    float daily_value = 0;
+    int previous_day = get_day_index(exit->exit_date_time);
+    long long daily_cents = print_day_totals(park, previous_day);
 
     while (current_node) {
         exit = current_node->val;
-        timestamp_t temp_date = exit->exit_date_time;
-        if (compare_date(previous_date, temp_date)) {
+        int day = get_day_index(exit->exit_date_time);
+        if (day != previous_day) {
             // Different date then previous
-            printf("%02d-%02d-%4d %.2f\n",
-               previous_date.d, previous_date.mth,
-               previous_date.y, daily_value);
-            daily_value = 0;
+            print_daily_cents(previous_day, daily_cents);
+            daily_cents = 0;
         }
-        daily_value += exit->paid_value;
-        previous_date = exit->exit_date_time;
+        daily_cents += to_cents(exit->paid_value);
+        previous_day = day;
         
         current_node = current_node->next;  
     }
-    printf("%02d-%02d-%4d %.2f\n",
-               previous_date.d, previous_date.mth,
-               previous_date.y, daily_value);
+    print_daily_cents(previous_day, daily_cents);
+}
+
+
+/**
+ * Shows the facturation of a park, on the given day if by_day
+ * is set or else of every day, with compact history or not.
+*/
+void print_park_facturation(park_t* park, int by_day,
+                              timestamp_t date, system_t* sys) {
+    if (by_day && print_aged_out_day(park, date))
+        return;
+    if (by_day && park->history)
+        print_history_facturation_by_day(park, date, sys);
+    else if (by_day)
+        print_facturation_by_day(park, date);
+    else if (park->history)
+        print_history_facturation(park, sys);
+    else
+        print_facturation(park);
+}
+
+/**
+ * Converts a facturation value to an integer number of cents,
+ * so revenue sums do not accumulate floating point error.
+*/
+long long to_cents(float value) {
+    return (long long)(value * 100 + 0.5f);
+}
+
+/**
+ * Adds the value paid at an exit to the park's revenue index
+ * and to the system wide one, in the bucket of the exit day.
+*/
+void index_revenue(park_t* park, timestamp_t exit_d,
+                long long cents, system_t* sys) {
+    int day = get_day_index(exit_d);
+    fenwick_add(park->revenue_idx, day, cents);
+    lock_system(sys);
+    fenwick_add(sys->revenue_idx, day, cents);
+    unlock_system(sys);
+}
+
+/**
+ * Takes every day of a park's revenue out of the system wide
+ * index, used before the park is removed.
+*/
+void unindex_park_revenue(park_t* park, system_t* sys) {
+    for (int day = 0; day < park->revenue_idx->size; day++) {
+        long long cents = fenwick_range(park->revenue_idx, day, day);
+        if (cents)
+            fenwick_add(sys->revenue_idx, day, -cents);
+    }
+}
+
+/**
+ * Shows the revenue recorded in the given index
+ * between two dates (both inclusive).
+*/
+void print_revenue(fenwick_t* revenue_idx,
+            timestamp_t from, timestamp_t to) {
+    long long cents = fenwick_range(revenue_idx,
+     get_day_index(from), get_day_index(to));
+    printf("%lld.%02lld\n", cents / 100, cents % 100);
 }
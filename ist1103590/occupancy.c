@@ -0,0 +1,239 @@
+/**
+ * @file occupancy.c
+ * 
+ * @author Tiago Firmino - ist1103590
+ * 
+ * File containing functions used to record and query
+ * the occupancy history of each park.
+ * Every change of occupancy is stored as a point in a
+ * series of fixed size blocks, each point being encoded as
+ * a varint time delta and a zigzag occupancy delta
+ * relative to the previous point.
+ * 
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/**
+ * Creates a new empty occupancy series.
+*/
+occupancy_series_t* init_series() {
+    occupancy_series_t* series =
+     (occupancy_series_t*)safe_malloc(sizeof(occupancy_series_t));
+    series->capacity = SERIES_INIT_BLOCKS;
+    series->num_blocks = 0;
+    series->blocks = (series_block_t*)safe_malloc(series->capacity *
+     sizeof(series_block_t));
+    return series;
+}
+
+/**
+ * Frees the series and its blocks.
+*/
+void free_series(occupancy_series_t* series) {
+    safe_free(series->blocks);
+    safe_free(series);
+}
+
+/**
+ * Writes an unsigned value as a varint, 7 bits per byte.
+ * Returns the number of bytes written.
+*/
+int encode_varint(unsigned char* buf, unsigned value) {
+    int n = 0;
+    while (value >= 0x80) {
+        buf[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = (unsigned char)value;
+    return n;
+}
+
+/**
+ * Reads a varint, returning the number of bytes read.
+*/
+int decode_varint(const unsigned char* buf, unsigned* value) {
+    int n = 0, shift = 0;
+    *value = 0;
+    do {
+        *value |= (unsigned)(buf[n] & 0x7f) << shift;
+        shift += 7;
+    } while (buf[n++] & 0x80);
+    return n;
+}
+
+/**
+ * Zigzag encoding so small negative deltas stay small.
+*/
+unsigned zigzag(int value) {
+    return ((unsigned)value << 1) ^ (unsigned)(value >> 31);
+}
+
+/**
+ * Reverses the zigzag encoding of a delta.
+*/
+int unzigzag(unsigned value) {
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+/**
+ * Appends a point to the series, meaning that from the given
+ * minute on the park holds the given number of vehicles.
+ * Points must be appended in chronological order.
+*/
+void series_append(occupancy_series_t* series, int time,
+                     int occupancy) {
+    series_block_t* last = series->num_blocks ?
+     &series->blocks[series->num_blocks - 1] : NULL;
+
+    if (last && last->used + SERIES_MAX_POINT_BYTES <= SERIES_BLOCK_BYTES) {
+        last->used += encode_varint(last->data + last->used,
+         (unsigned)(time - last->last_time));
+        last->used += encode_varint(last->data + last->used,
+         zigzag(occupancy - last->last_occupancy));
+        last->last_area += (long long)last->last_occupancy *
+         (time - last->last_time);
+        last->last_time = time;
+        last->last_occupancy = occupancy;
+        if (occupancy > last->max_occupancy)
+            last->max_occupancy = occupancy;
+        return;
+    }
+
+    if (series->num_blocks == series->capacity) {
+        series->capacity *= 2;
+        series->blocks = (series_block_t*)safe_realloc(series->blocks,
+         series->capacity * sizeof(series_block_t));
+        last = &series->blocks[series->num_blocks - 1];
+    }
+    series_block_t* block = &series->blocks[series->num_blocks++];
+    block->base_area = last ? last->last_area +
+     (long long)last->last_occupancy * (time - last->last_time) : 0;
+    block->last_area = block->base_area;
+    block->base_time = block->last_time = time;
+    block->base_occupancy = block->last_occupancy = occupancy;
+    block->max_occupancy = occupancy;
+    block->used = 0;
+}
+
+/**
+ * Binary searches for the last block starting at or before
+ * the given minute. Returns INVALID if there is none.
+*/
+int series_find_block(occupancy_series_t* series, int time) {
+    int lo = 0, hi = series->num_blocks - 1, found = INVALID;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (series->blocks[mid].base_time <= time) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+/**
+ * Returns the occupancy at the given minute (after every change
+ * made on that minute) and stores in area the vehicle minutes
+ * accumulated up to it.
+*/
+int series_occupancy_at(occupancy_series_t* series, int time,
+                          long long* area) {
+    int idx = series_find_block(series, time);
+    if (idx == INVALID) {
+        *area = 0;
+        return 0;
+    }
+    series_block_t* block = &series->blocks[idx];
+    int pos = 0, prev_time = block->base_time;
+    int occupancy = block->base_occupancy;
+    *area = block->base_area;
+
+    if (time >= block->last_time) {
+        *area = block->last_area + (long long)block->last_occupancy *
+         (time - block->last_time);
+        return block->last_occupancy;
+    }
+    while (pos < block->used) {
+        unsigned dt, dv;
+        int n = decode_varint(block->data + pos, &dt);
+        if (prev_time + (int)dt > time) break;
+        pos += n;
+        pos += decode_varint(block->data + pos, &dv);
+        *area += (long long)occupancy * dt;
+        prev_time += dt;
+        occupancy += unzigzag(dv);
+    }
+    *area += (long long)occupancy * (time - prev_time);
+    return occupancy;
+}
+
+/**
+ * Returns the highest occupancy of the series between
+ * two minutes (both inclusive).
+ * Blocks entirely inside the range use their stored maximum,
+ * the others are decoded.
+*/
+int series_peak(occupancy_series_t* series, int from, int to) {
+    long long area;
+    int peak = series_occupancy_at(series, from, &area);
+    int idx = series_find_block(series, from);
+
+    for (idx = idx == INVALID ? 0 : idx; idx < series->num_blocks; idx++) {
+        series_block_t* block = &series->blocks[idx];
+        if (block->base_time > to) break;
+        if (block->last_time <= from) continue;
+        if (block->base_time > from && block->last_time <= to) {
+            if (block->max_occupancy > peak)
+                peak = block->max_occupancy;
+            continue;
+        }
+        int pos = 0, time = block->base_time;
+        int occupancy = block->base_occupancy;
+        while (TRUE) {
+            if (time > to) break;
+            if (time > from && occupancy > peak) peak = occupancy;
+            if (pos >= block->used) break;
+            unsigned dt, dv;
+            pos += decode_varint(block->data + pos, &dt);
+            pos += decode_varint(block->data + pos, &dv);
+            time += dt;
+            occupancy += unzigzag(dv);
+        }
+    }
+    return peak;
+}
+
+/**
+ * Shows the occupancy of a park at the given date and time.
+*/
+void print_occupancy_at(park_t* park, timestamp_t at) {
+    long long area;
+    printf("%d\n", series_occupancy_at(park->occupancy,
+     get_minute_index(at), &area));
+}
+
+/**
+ * Shows the peak and the (time weighted) average occupancy
+ * of a park between two dates and times.
+*/
+void print_occupancy_range(park_t* park, timestamp_t from,
+                             timestamp_t to) {
+    long long area_from, area_to;
+    int start = get_minute_index(from), end = get_minute_index(to);
+    int occupancy = series_occupancy_at(park->occupancy, start, &area_from);
+    float average = occupancy;
+
+    if (end > start) {
+        series_occupancy_at(park->occupancy, end, &area_to);
+        average = (float)(area_to - area_from) / (end - start);
+    }
+    printf("%d %.2f\n", series_peak(park->occupancy, start, end), average);
+}
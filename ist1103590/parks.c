@@ -17,7 +17,8 @@
 /**
  * Creates a new park initializing its values
  * and inserts it into the system's park list
- * and inserts it into the system's sorted park list (by park name),
+ * and inserts it into the system's park directory (by park name),
+ * giving it the lowest free park id,
  * incrementing the number of parks in the system.
 */
 void create_parking(char* park_name, int capacity,
@@ -35,14 +36,29 @@ void create_parking(char* park_name, int capacity,
      tariff.max_daily_price;
 
     new_park->num_vehicles = 0;
+    new_park->version = 0;
     
     new_park->park_entries = init_list();
     new_park->park_exits = init_list();
+    new_park->open_entries = init_list();
     new_park->park_vehicles = init_list();
+    new_park->revenue_idx = init_fenwick();
+    new_park->occupancy = init_series();
+    new_park->visitors = init_daily(sizeof(hll_t));
+    new_park->durations = init_daily(sizeof(duration_histogram_t));
+    new_park->stays = init_stay_index();
+    new_park->top_paid = init_leaderboard();
+    new_park->top_visits = init_leaderboard();
+    new_park->history = sys->compact_history ? init_history() : NULL;
+    new_park->day_totals = init_list();
     
     sys->num_parks++;
-    insert_list(sys->parks, new_park);
-    sorted_insert_list(sys->srtd_parks, new_park, PARK_COMMAND);
+    new_park->parks_node = insert_list(sys->parks, new_park);
+    skiplist_insert(sys->srtd_parks, new_park->park_name, new_park);
+
+    for (new_park->id = 0; sys->park_ids[new_park->id]; new_park->id++);
+    sys->park_ids[new_park->id] = new_park;
+    update_park_ranks(sys);
 }
 
 /**
@@ -51,9 +67,7 @@ void create_parking(char* park_name, int capacity,
 void list_parks(system_t* sys) {
     node_t* current = sys->parks->head;
     while (current != NULL) {
-        park_t* p = (park_t*)current->val;
-        printf("%s %d %d\n", p->park_name, p->park_capacity,
-         p->park_capacity - p->num_vehicles);
+        print_park((park_t*)current->val);
         current = current->next;
     }
 }
@@ -61,41 +75,57 @@ void list_parks(system_t* sys) {
 /**
  * Removes a park node and its dependencies from the system,
  * notably, deletes the park's entries and exits lists as well
- * as the park's vehicle list and frees the park name.
+ * as the park's vehicle list and frees the park name,
+ * dropping every cached query result.
  * Then lists the remaining parks sorted by park name.
 */
 void remove_parks(park_t* park, system_t* sys) {    
+    invalidate_query_cache(sys->cache);
+    unindex_park_revenue(park, sys);
+    free_fenwick(park->revenue_idx);
+    free_series(park->occupancy);
+    free_daily(park->visitors);
+    free_daily(park->durations);
+    free_stay_index(park->stays);
+    unrank_park(park, sys);
+    safe_free(park->top_paid);
+    safe_free(park->top_visits);
     delete_list(park->park_entries);
     delete_list(park->park_exits);
+    delete_list(park->open_entries);
     
     sys->num_parks--;
-    delete_node(sys->parks, park);
+    unlink_node(sys->parks, park->parks_node);
 
     node_t* current_vehicle = park->park_vehicles->head;
     while (current_vehicle) {
         vehicle_t* vehicle = 
          (vehicle_t*)current_vehicle->val;
+        if (park->history)
+            safe_free(vehicle->current_entry);
+        cancel_alert(sys->alerts, vehicle);
         vehicle->current_entry = NULL;
-        current_vehicle = current_vehicle->next;
-        delete_node(park->park_vehicles, vehicle);
+        vehicle->park_node = NULL;
+        node_t* next = current_vehicle->next;
+        safe_free(current_vehicle);
+        current_vehicle = next;
     }
-    free(park->park_vehicles);
+    safe_free(park->park_vehicles);
+    if (park->history)
+        free_history(park->history);
+    delete_list(park->day_totals);
     
-    node_t* current_park = sys->srtd_parks->head;
+    skiplist_delete(sys->srtd_parks, park->park_name);
+    forget_park_events(sys->events, park->id);
+    sys->park_ids[park->id] = NULL;
+    update_park_ranks(sys);
+    skip_node_t* current_park = skiplist_lower_bound(sys->srtd_parks, NULL);
     while (current_park != NULL) {
-        park_t* temp_park = (park_t*)current_park->val;
-        if (park == temp_park) {
-            node_t* temp = current_park->next;
-            delete_node(sys->srtd_parks, temp_park);
-            current_park = temp;
-            continue;
-        }
-        printf("%s\n", temp_park->park_name);
-
-        current_park = current_park->next;
+        printf("%s\n", current_park->key);
+        current_park = current_park->next[0];
     }
-    free(park->park_name);
-    free(park);
+    safe_free(park->park_name);
+    safe_free(park);
 }
 
 /**
@@ -130,17 +160,75 @@ int invalid_park_args(char* park_name, int capacity,
 
 /**
  * Performs a lookup for the given park name in the 
- * sytem's park list.
+ * sytem's sorted park directory.
 */
 park_t* lookup_park(char* park_name, system_t* sys) {
-    node_t* current = sys->parks->head;
-    while (current != NULL) {
-        park_t* park = (park_t*)current->val;
+    skip_node_t* node = skiplist_lower_bound(sys->srtd_parks, park_name);
 
-        if (!strcmp(park->park_name, park_name))
-            return park;
+    if (node && !strcmp(node->key, park_name))
+        return (park_t*)node->val;
+    return NULL;
+}
 
+/**
+ * Lists the vehicles currently inside the given park,
+ * in order of arrival, with their entry date and time.
+*/
+void list_park_vehicles(park_t* park) {
+    node_t* current = park->park_vehicles->head;
+    while (current != NULL) {
+        vehicle_t* vhc = (vehicle_t*)current->val;
+        printf("%s %02d-%02d-%4d %02d:%02d\n", vhc->license_plate,
+         vhc->last_entry.d, vhc->last_entry.mth, vhc->last_entry.y,
+         vhc->last_entry.h, vhc->last_entry.min);
         current = current->next;
     }
-    return NULL;
+}
+
+/**
+ * Recomputes the position of every park in name order,
+ * indexed by park id. Walks the whole directory, so creating
+ * or removing a park takes linear time; that is only cheap
+ * because there are at most MAX_P parks.
+*/
+void update_park_ranks(system_t* sys) {
+    int rank = 0;
+    skip_node_t* current = skiplist_lower_bound(sys->srtd_parks, NULL);
+    while (current) {
+        sys->park_rank[((park_t*)current->val)->id] = rank++;
+        current = current->next[0];
+    }
+}
+
+/**
+ * Prints a park in the same format as the park listing.
+*/
+void print_park(park_t* p) {
+    printf("%s %d %d\n", p->park_name, p->park_capacity,
+     p->park_capacity - p->num_vehicles);
+}
+
+/**
+ * Lists, sorted by name, the parks whose name starts
+ * with the given prefix.
+*/
+void list_parks_by_prefix(char* prefix, system_t* sys) {
+    int len = strlen(prefix);
+    skip_node_t* current = skiplist_lower_bound(sys->srtd_parks, prefix);
+    while (current && !strncmp(current->key, prefix, len)) {
+        print_park((park_t*)current->val);
+        current = current->next[0];
+    }
+}
+
+/**
+ * Lists, sorted by name, the parks whose name is
+ * between the two given names (both inclusive).
+*/
+void list_parks_in_range(char* from, char* to, system_t* sys) {
+    skip_node_t* current = skiplist_lower_bound(sys->srtd_parks, from);
+    while (current && strcmp(current->key, to) <= 0) {
+        print_park((park_t*)current->val);
+        current = current->next[0];
+    }
 }
@@ -21,15 +21,53 @@
  * Repeatedly waits for a new command.
  * Ends the program by freeing all the used memory.
  */
-int main() {
+int main(int argc, char* argv[]) {
 	char* buffer;
+	int c;
 	system_t* sys = init_system();
+	parse_options(argc, argv, sys);
 	buffer = safe_malloc(MAX_LINE_SIZE * sizeof(char));
-	while (command_processor(getchar(), sys, buffer));
+	if (sys->num_shards)
+		run_router(sys, buffer);
+	else if (sys->binary_protocol)
+		run_binary(sys, buffer);
+	else
+		while ((c = getchar()) != EOF && command_processor(c, sys, buffer))
+			pump_events(sys);
+	wait_snapshots();
 	free_mem(sys, buffer);
 	return 0;
 }
 
+/**
+ * Applies the command line options to the system.
+ * -c keeps the movement history of every park compacted.
+ * -m <kilobytes> sets a memory budget.
+ * -w <workers> splits the parks among worker processes.
+ * -b takes entries and exits as binary records.
+ */
+void parse_options(int argc, char* argv[], system_t* sys) {
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], COMPACT_HISTORY_OPTION))
+			sys->compact_history = TRUE;
+		else if (!strcmp(argv[i], MEMORY_BUDGET_OPTION) && i + 1 < argc)
+			set_mem_budget(atoll(argv[++i]) * 1024);
+		else if (!strcmp(argv[i], ROUTER_OPTION) && i + 1 < argc) {
+			sys->num_shards = atoi(argv[++i]);
+			if (sys->num_shards < 1 || sys->num_shards > MAX_SHARDS) {
+				printf(ROUTER_INVALID_SHARDS, sys->num_shards);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (!strcmp(argv[i], BINARY_OPTION))
+			sys->binary_protocol = TRUE;
+	}
+	if (sys->binary_protocol && sys->num_shards) {
+		printf(BINARY_WITH_ROUTER);
+		exit(EXIT_FAILURE);
+	}
+}
+
 /**
  * Initializes the system struct.
  * Creates a new system and initializes the
@@ -43,9 +81,35 @@ system_t* init_system() {
     system_t* new_system = (system_t*)safe_malloc(sizeof(system_t));
 
     new_system->parks = init_list();
-	new_system->srtd_parks = init_list();
+	new_system->srtd_parks = init_skiplist();
+	for (int i = 0; i < MAX_P; i++) {
+		new_system->park_ids[i] = NULL;
+	}
 
+	new_system->revenue_idx = init_fenwick();
+	new_system->top_paid = init_leaderboard();
+	new_system->top_visits = init_leaderboard();
+
+	int scope = mem_scope(MEM_VEHICLES);
 	new_system->vhc_ht = init_ht();
+	new_system->num_vehicles = 0;
+	new_system->vehicle_ids_capacity = HASH_TABLE_SIZE;
+	new_system->vehicle_ids = (vehicle_t**)safe_malloc(
+		new_system->vehicle_ids_capacity * sizeof(vehicle_t*));
+	mem_scope(scope);
+	new_system->compact_history = FALSE;
+	new_system->retention_days = 0;
+	new_system->retention_next = 0;
+	new_system->bulk_loading = FALSE;
+	new_system->num_movements = 0;
+	new_system->num_shards = 0;
+	new_system->entry_elsewhere = FALSE;
+	new_system->gates = NULL;
+	new_system->cache = init_query_cache();
+	new_system->alerts = init_alerts();
+	new_system->raw_sketches = FALSE;
+	new_system->binary_protocol = FALSE;
+	new_system->events = init_events();
 
     new_system->num_parks = 0;
 
@@ -98,15 +162,87 @@ int command_processor(char command, system_t* sys, char* buffer) {
 		case PAID_COMAMND:
 			exec_show_val(sys);
 			return 1;
+
+		case OCCUPANTS_COMMAND:
+			exec_list_park_vehicles(sys, buffer);
+			return 1;
+
+		case REVENUE_COMMAND:
+			exec_revenue_query(sys, buffer);
+			return 1;
+
+		case VISITORS_COMMAND:
+			exec_distinct_vehicles(sys, buffer);
+			return 1;
+
+		case DURATIONS_COMMAND:
+			exec_stay_durations(sys, buffer);
+			return 1;
+
+		case OCCUPANCY_COMMAND:
+			exec_occupancy_query(sys, buffer);
+			return 1;
+
+		case TOP_COMMAND:
+			exec_show_leaderboards(sys, buffer);
+			return 1;
+
+		case RETENTION_COMMAND:
+			exec_set_retention(sys, buffer);
+			return 1;
+
+		case DIRECTORY_COMMAND:
+			exec_park_directory(sys, buffer);
+			return 1;
+
+		case BULK_COMMAND:
+			exec_bulk_load(sys, buffer);
+			return 1;
+
+		case MEMORY_COMMAND:
+			exec_memory(sys, buffer);
+			return 1;
+
+		case SNAPSHOT_COMMAND:
+			exec_snapshot(sys, buffer);
+			return 1;
+
+		case GATES_COMMAND:
+			exec_gate_ingest(sys, buffer);
+			return 1;
+
+		case EXPORT_COMMAND:
+			exec_export(sys, buffer);
+			return 1;
+
+		case ALERT_COMMAND:
+			exec_alerts(sys, buffer);
+			return 1;
+
+		case PRESENT_COMMAND:
+			exec_present_vehicles(sys, buffer);
+			return 1;
+
+		case REPORT_COMMAND:
+			exec_revenue_report(sys, buffer);
+			return 1;
+
+		case SUBSCRIBE_COMMAND:
+			exec_subscribe(sys, buffer);
+			return 1;
 		default:
 	        if (command == ' ' || command == '\t' || command == '\n') break;
 	}
 	return 1;
 }
 
+/**
+ * Handles the 'u' command.
+ * Shows the total value paid by a vehicle in every park.
+ */
 void exec_show_val(system_t* sys) {
 	char license_plate[V_LICENSE_PLT_LENGTH];
-	float total_paid = 0;
+	long long total_paid = 0;
 
 	read_spaces();
 	scanf("%s", license_plate);
@@ -116,26 +252,10 @@ void exec_show_val(system_t* sys) {
 	}
  
 	vehicle_t* vhc = search_ht(sys->vhc_ht, license_plate);
-	
-	//if (vhc) {
-	node_t* current_park = sys->parks->head;
-	while (current_park){
-		park_t* park = (park_t*)current_park->val;
-		node_t* current_exit = park->park_exits->head;
-		exit_t* exit = (exit_t*)current_exit->val;
-		while (current_exit) {
-			if (vhc == exit->vehicle) {
-				total_paid += exit->paid_value;
-			}
-			current_exit =  current_exit->next;
-
-		}
-
-		current_park = current_park->next;
+	if (vhc) {
+		total_paid = vhc->total_cents;
 	}
-
-	//}
-	printf("%.2f\n",total_paid);
+	printf("%lld.%02lld\n", total_paid / 100, total_paid % 100);
 }
 
 
@@ -155,7 +275,7 @@ void exec_create_parking(system_t* sys, char* buffer) {
 		return;
 	}
 	char* park_name = parse_allocate_name(buffer);
-	if (!strcmp(park_name, "invalid")) {
+	if (!park_name) {
 		printf(PARK_INVALID_NAME);
 		return;
 	}
@@ -167,14 +287,18 @@ void exec_create_parking(system_t* sys, char* buffer) {
 		tariff.hour_price = hour_price;
 		tariff.max_daily_price = max_daily_price;
 		if (invalid_park_args(park_name, capacity, tariff, sys)) {
-			free(park_name);
+			safe_free(park_name);
 			return;
+		} else if (!memory_admits(sys)) {
+			printf(MEMORY_BUDGET_EXCEEDED);
 		} else {
+			int scope = mem_scope(MEM_PARKS);
 			char* park_name_dup = duplicate_string(park_name);
 			create_parking(park_name_dup, capacity, tariff, sys);
+			mem_scope(scope);
 		}
 	}
-	free(park_name);
+	safe_free(park_name);
 	read_until_end(buffer);
 }
 
@@ -188,6 +312,11 @@ void exec_register_entry(system_t* sys, char* buffer) {
 	timestamp_t entry_date;
 	read_spaces();
 	char* park_name = parse_allocate_name(buffer);
+	if (!park_name) {
+		printf(PARK_INVALID_NAME);
+		read_until_end(buffer);
+		return;
+	}
 	read_spaces();
 
 	scanf("%s", license_plate);
@@ -195,22 +324,23 @@ void exec_register_entry(system_t* sys, char* buffer) {
 			&entry_date.d, &entry_date.mth,
 			&entry_date.y, &entry_date.h, &entry_date.min) != 5) {
 		printf(INVALID_DATE);
-		free(park_name);
+		safe_free(park_name);
 		return;
 	}
 	park_t* park = lookup_park(park_name, sys);
 	if (!park) {
         printf(PARK_DOESNT_EXIST, park_name);
-		free(park_name);
+		safe_free(park_name);
 		return;
 	} else if (invalid_movement_args(park, license_plate,
 		 entry_date, sys, is_entry)) {
 
-		free(park_name);
+		safe_free(park_name);
 		return;
 	}
 	register_entry(park, license_plate, entry_date, sys);
-	free(park_name);
+	retention_step(sys);
+	safe_free(park_name);
 	read_until_end(buffer);
 }
 
@@ -224,6 +354,11 @@ void exec_register_exit(system_t* sys, char* buffer) {
 	int is_entry = FALSE;
 	read_spaces();
 	char* park_name = parse_allocate_name(buffer);
+	if (!park_name) {
+		printf(PARK_INVALID_NAME);
+		read_until_end(buffer);
+		return;
+	}
 	read_spaces();
 
 	scanf("%s", license_plate);
@@ -231,22 +366,23 @@ void exec_register_exit(system_t* sys, char* buffer) {
 			&exit_date.d, &exit_date.mth,
 			&exit_date.y, &exit_date.h, &exit_date.min) != 5) {
 		printf(INVALID_DATE);
-		free(park_name);
+		safe_free(park_name);
 		return;
 	}
 	park_t* park = lookup_park(park_name, sys);
 	if (!park) {
         printf(PARK_DOESNT_EXIST, park_name);
-		free(park_name);
+		safe_free(park_name);
 		return;
 	} else if (invalid_movement_args(park, license_plate,
 		 exit_date, sys, is_entry)) {
 			
-		free(park_name);
+		safe_free(park_name);
 		return;
 	}
 	register_exit(park, license_plate, exit_date, sys);
-	free(park_name);
+	retention_step(sys);
+	safe_free(park_name);
 	read_until_end(buffer);
 }
 
@@ -265,7 +401,14 @@ void exec_log_vehicle_activity(system_t* sys) {
 	
 	if (invalid_vehicle_args(license_plate)) return;
 
+	vehicle_t* vhc = search_ht(sys->vhc_ht, license_plate);
+	char key[V_LICENSE_PLT_LENGTH + 2] = {VEHICLE_COMMAND, ' '};
+	strcpy(key + 2, license_plate);
+	if (vhc && serve_cached_query(sys->cache, key, vhc->version))
+		return;
+	if (vhc) begin_query_capture(sys->cache);
 	vehicle_activity_logs(license_plate, sys);
+	if (vhc) end_query_capture(sys->cache, key, vhc->version);
 }
 
 /**
@@ -276,15 +419,20 @@ void exec_log_vehicle_activity(system_t* sys) {
  */
 void exec_park_facturation(system_t* sys, char* buffer) {
 	char c = ' ';
-	timestamp_t facturation_date;
+	timestamp_t facturation_date = {0, 0, 0, 0, 0};
 	read_spaces();
 	char* park_name = parse_allocate_name(buffer);
+	if (!park_name) {
+		printf(PARK_INVALID_NAME);
+		read_until_end(buffer);
+		return;
+	}
 	c = read_spaces();
 
 	park_t* park = lookup_park(park_name, sys);
 	if (!park) {
 		printf(PARK_DOESNT_EXIST, park_name);
-		free(park_name);
+		safe_free(park_name);
 		return;
 	}
 	if (c) {
@@ -293,7 +441,7 @@ void exec_park_facturation(system_t* sys, char* buffer) {
 			&facturation_date.mth,
 			&facturation_date.y) != 3) {
 			printf(INVALID_DATE);
-			free(park_name);
+			safe_free(park_name);
 			return;
 		}
 		facturation_date.h = 0;
@@ -301,18 +449,25 @@ void exec_park_facturation(system_t* sys, char* buffer) {
 		if (compare_date(facturation_date,
 			 sys->date_registry) > 0) {
 			printf(INVALID_DATE);
-			free(park_name);
+			safe_free(park_name);
 			return;
 		}
 		if (invalid_factdate_args(facturation_date, sys)) {
-			free(park_name);
+			safe_free(park_name);
 			return;
 		}
-		print_facturation_by_day(park, facturation_date);
+		snprintf(buffer, MAX_LINE_SIZE, "%c %s %02d-%02d-%04d",
+		 FACT_COMMAND, park_name, facturation_date.d,
+		 facturation_date.mth, facturation_date.y);
 	} else {
-		print_facturation(park);
+		snprintf(buffer, MAX_LINE_SIZE, "%c %s", FACT_COMMAND, park_name);
+	}
+	if (!serve_cached_query(sys->cache, buffer, park->version)) {
+		begin_query_capture(sys->cache);
+		print_park_facturation(park, c, facturation_date, sys);
+		end_query_capture(sys->cache, buffer, park->version);
 	}
-	free(park_name);
+	safe_free(park_name);
 }
 
 /**
@@ -322,22 +477,515 @@ void exec_park_facturation(system_t* sys, char* buffer) {
  * and listing the remaining parks sorted by park name.
  */
 void exec_remove_park(system_t* sys, char* buffer) {
-	char* park_name; 
-	int name_len = 0;
 	read_spaces();
-	name_len = read_name(buffer);
-	park_name = safe_malloc(name_len * (sizeof(char)));
-	memcpy(park_name, buffer, name_len);
+	char* park_name = parse_allocate_name(buffer);
+	if (!park_name) {
+		printf(PARK_INVALID_NAME);
+		read_until_end(buffer);
+		return;
+	}
 	read_spaces();
 	
 	park_t* park = lookup_park(park_name, sys); 
 	if (!park) {
 		printf(PARK_DOESNT_EXIST, park_name);
-		free(park_name);
+		safe_free(park_name);
 		return;
 	}
 	remove_parks(park, sys);
-	free(park_name);
+	safe_free(park_name);
+}
+
+/**
+ * Handles the 'l' command.
+ * Lists the vehicles that are currently inside a park.
+ */
+void exec_list_park_vehicles(system_t* sys, char* buffer) {
+	read_spaces();
+	char* park_name = parse_allocate_name(buffer);
+	if (!park_name) {
+		printf(PARK_INVALID_NAME);
+		read_until_end(buffer);
+		return;
+	}
+	if (read_spaces()) read_until_end(buffer);
+
+	park_t* park = lookup_park(park_name, sys);
+	if (!park) {
+		printf(PARK_DOESNT_EXIST, park_name);
+		safe_free(park_name);
+		return;
+	}
+	list_park_vehicles(park);
+	safe_free(park_name);
+}
+
+/**
+ * Reads the arguments of a query over a range of dates: an optional
+ * park name followed by two dates (both inclusive).
+ * Sets park to NULL if no park name is given.
+ * Returns FALSE, after printing the error, if they are invalid.
+ */
+int read_range_query(system_t* sys, char* buffer, park_t** park,
+					timestamp_t* from, timestamp_t* to) {
+	char* park_name = NULL;
+	int c, more = TRUE;
+
+	*park = NULL;
+	read_spaces();
+	c = getchar();
+	ungetc(c, stdin);
+	if (!is_digit(c)) {
+		park_name = parse_allocate_name(buffer);
+		if (!park_name) {
+			printf(PARK_INVALID_NAME);
+			read_until_end(buffer);
+			return FALSE;
+		}
+		more = read_spaces();
+	}
+	if (!more || !read_date(from) || !(more = read_spaces()) ||
+		!read_date(to) || invalid_date(*from, sys, TRUE) ||
+		invalid_date(*to, sys, TRUE) || compare_date(*from, *to) > 0) {
+		printf(INVALID_DATE);
+		if (more) read_until_end(buffer);
+		safe_free(park_name);
+		return FALSE;
+	}
+	if (read_spaces()) read_until_end(buffer);
+
+	if (park_name) {
+		*park = lookup_park(park_name, sys);
+		if (!*park) {
+			printf(PARK_DOESNT_EXIST, park_name);
+			safe_free(park_name);
+			return FALSE;
+		}
+	}
+	safe_free(park_name);
+	return TRUE;
+}
+
+/**
+ * Handles the 'g' command.
+ * Shows the revenue of a park, or of every park if no park
+ * name is given, between two dates (both inclusive).
+ */
+void exec_revenue_query(system_t* sys, char* buffer) {
+	timestamp_t from, to;
+	park_t* park;
+
+	if (!read_range_query(sys, buffer, &park, &from, &to)) return;
+	print_revenue(park ? park->revenue_idx : sys->revenue_idx, from, to);
+}
+
+/**
+ * Handles the 'h' command.
+ * Shows the estimated number of distinct vehicles that entered
+ * a park, or any park if no park name is given, between two
+ * dates (both inclusive).
+ */
+void exec_distinct_vehicles(system_t* sys, char* buffer) {
+	timestamp_t from, to;
+	park_t* park;
+
+	if (!read_range_query(sys, buffer, &park, &from, &to)) return;
+	print_distinct_vehicles(park, from, to, sys);
+}
+
+/**
+ * Handles the 'd' command.
+ * Shows how many stays ended in a park, or in any park if no
+ * park name is given, between two dates (both inclusive), and
+ * the median, 90th and 99th percentile of their lengths in minutes.
+ */
+void exec_stay_durations(system_t* sys, char* buffer) {
+	timestamp_t from, to;
+	park_t* park;
+
+	if (!read_range_query(sys, buffer, &park, &from, &to)) return;
+	print_stay_durations(park, from, to, sys);
+}
+
+/**
+ * Reads the arguments of a query about a park at a date and time,
+ * or between two dates and times (both inclusive).
+ * Sets to to from if only one date and time is given.
+ * Returns FALSE, after printing the error, if they are invalid.
+ */
+int read_instant_query(system_t* sys, char* buffer, park_t** park,
+					timestamp_t* from, timestamp_t* to, int* is_range) {
+	int more;
+
+	read_spaces();
+	char* park_name = parse_allocate_name(buffer);
+	if (!park_name) {
+		printf(PARK_INVALID_NAME);
+		read_until_end(buffer);
+		return FALSE;
+	}
+	more = read_spaces();
+	if (!more || !read_date_time(from) ||
+		invalid_date(*from, sys, TRUE)) {
+		printf(INVALID_DATE);
+		if (more) read_until_end(buffer);
+		safe_free(park_name);
+		return FALSE;
+	}
+	if ((more = read_spaces()) && (!read_date_time(to) ||
+		invalid_date(*to, sys, TRUE) ||
+		get_minute_index(*from) > get_minute_index(*to))) {
+		printf(INVALID_DATE);
+		read_until_end(buffer);
+		safe_free(park_name);
+		return FALSE;
+	}
+	if (more && read_spaces()) read_until_end(buffer);
+	if (!more) *to = *from;
+	*is_range = more;
+
+	*park = lookup_park(park_name, sys);
+	if (!*park) printf(PARK_DOESNT_EXIST, park_name);
+	safe_free(park_name);
+	return *park != NULL;
+}
+
+/**
+ * Handles the 'o' command.
+ * Shows the occupancy of a park at a given date and time,
+ * or its peak and average occupancy if a second
+ * date and time is given.
+ */
+void exec_occupancy_query(system_t* sys, char* buffer) {
+	timestamp_t from, to;
+	park_t* park;
+	int is_range;
+
+	if (!read_instant_query(sys, buffer, &park, &from, &to, &is_range))
+		return;
+	if (is_range)
+		print_occupancy_range(park, from, to);
+	else
+		print_occupancy_at(park, from);
+}
+
+/**
+ * Handles the 'w' command.
+ * Shows the vehicles that were in a park at a given date and
+ * time, or at some point between two dates and times.
+ */
+void exec_present_vehicles(system_t* sys, char* buffer) {
+	timestamp_t from, to;
+	park_t* park;
+	int is_range;
+
+	if (!read_instant_query(sys, buffer, &park, &from, &to, &is_range))
+		return;
+	print_present(park, get_minute_index(from), get_minute_index(to), sys);
+}
+
+/**
+ * Handles the 'c' command.
+ * Shows the daily facturation of every park and their total.
+ */
+void exec_revenue_report(system_t* sys, char* buffer) {
+	if (read_spaces()) read_until_end(buffer);
+	print_revenue_report(sys);
+}
+
+/**
+ * Handles the 'z' command.
+ * Subscribes a file, pipe or socket to the changes of the
+ * free spots of a park, or of every park if none is given.
+ */
+void exec_subscribe(system_t* sys, char* buffer) {
+	park_t* park = NULL;
+
+	if (!read_spaces() || scanf("%s", buffer) != 1) {
+		printf(EVENTS_INVALID);
+		return;
+	}
+	char* path = duplicate_string(buffer);
+	if (read_spaces()) {
+		char* park_name = parse_allocate_name(buffer);
+		if (!park_name) {
+			printf(PARK_INVALID_NAME);
+			safe_free(path);
+			return;
+		}
+		park = lookup_park(park_name, sys);
+		if (!park) {
+			printf(PARK_DOESNT_EXIST, park_name);
+			safe_free(park_name);
+			safe_free(path);
+			return;
+		}
+		safe_free(park_name);
+		if (read_spaces()) read_until_end(buffer);
+	}
+	subscribe(path, park, sys);
+	safe_free(path);
+}
+
+/**
+ * Handles the 't' command.
+ * Shows the vehicles that paid the most and the vehicles
+ * with the most visits, in a park or in the whole system
+ * if no park name is given.
+ */
+void exec_show_leaderboards(system_t* sys, char* buffer) {
+	leaderboard_t *top_paid = sys->top_paid, *top_visits = sys->top_visits;
+	char* park_name = NULL;
+	int c, count = 0, more = read_spaces();
+
+	c = getchar();
+	ungetc(c, stdin);
+	if (more && !is_digit(c) && c != '-') {
+		park_name = parse_allocate_name(buffer);
+		if (!park_name) {
+			printf(PARK_INVALID_NAME);
+			read_until_end(buffer);
+			return;
+		}
+		more = read_spaces();
+	}
+	if (!more || scanf("%d", &count) != 1 ||
+		count <= 0 || count > TOPK_MAX) {
+		printf(TOPK_INVALID_COUNT, count);
+		if (more) read_until_end(buffer);
+		safe_free(park_name);
+		return;
+	}
+	if (read_spaces()) read_until_end(buffer);
+
+	if (park_name) {
+		park_t* park = lookup_park(park_name, sys);
+		if (!park) {
+			printf(PARK_DOESNT_EXIST, park_name);
+			safe_free(park_name);
+			return;
+		}
+		top_paid = park->top_paid;
+		top_visits = park->top_visits;
+	}
+	print_leaderboards(top_paid, top_visits, count);
+	safe_free(park_name);
+}
+
+/**
+ * Handles the 'k' command.
+ * Sets how many days of detailed movements are kept,
+ * older ones being aged out into daily totals.
+ * Zero keeps every movement.
+ */
+void exec_set_retention(system_t* sys, char* buffer) {
+	int days = 0, more = read_spaces();
+
+	if (!more || scanf("%d", &days) != 1 || days < 0) {
+		printf(RETENTION_INVALID, days);
+		if (more) read_until_end(buffer);
+		return;
+	}
+	if (read_spaces()) read_until_end(buffer);
+	sys->retention_days = days;
+}
+
+/**
+ * Handles the 'n' command.
+ * Lists, sorted by name, the parks whose name starts with
+ * the given prefix, or whose name is between two given names.
+ */
+void exec_park_directory(system_t* sys, char* buffer) {
+	char *from, *to;
+
+	read_spaces();
+	from = parse_allocate_name(buffer);
+	if (!from) {
+		printf(PARK_INVALID_NAME);
+		read_until_end(buffer);
+		return;
+	}
+	if (!read_spaces()) {
+		list_parks_by_prefix(from, sys);
+		safe_free(from);
+		return;
+	}
+	to = parse_allocate_name(buffer);
+	if (!to) {
+		printf(PARK_INVALID_NAME);
+		read_until_end(buffer);
+		safe_free(from);
+		return;
+	}
+	if (read_spaces()) read_until_end(buffer);
+	list_parks_in_range(from, to, sys);
+	safe_free(from);
+	safe_free(to);
+}
+
+/**
+ * Handles the 'b' command.
+ * Loads the movements of a file in bulk, or of several
+ * files merged by the minute of their movements.
+ */
+void exec_bulk_load(system_t* sys, char* buffer) {
+	char* paths[MERGE_MAX_FEEDS];
+	int num_paths = 0;
+
+	while (num_paths < MERGE_MAX_FEEDS && read_spaces() &&
+		scanf("%s", buffer) == 1) {
+		paths[num_paths++] = duplicate_string(buffer);
+	}
+	if (num_paths == MERGE_MAX_FEEDS && read_spaces()) read_until_end(buffer);
+	if (!num_paths) {
+		printf(BULK_NO_FILE, "");
+		return;
+	}
+	bulk_load(paths, num_paths, sys);
+	for (int i = 0; i < num_paths; i++) {
+		safe_free(paths[i]);
+	}
+}
+
+/**
+ * Handles the 'm' command.
+ * Shows the memory in use by each subsystem and how many queries
+ * were answered from the cache, or sets the memory budget in
+ * kilobytes if one is given (0 for no budget).
+ */
+void exec_memory(system_t* sys, char* buffer) {
+	int kilobytes = 0;
+
+	if (!read_spaces()) {
+		print_memory_report();
+		print_cache_stats(sys->cache);
+		return;
+	}
+	if (scanf("%d", &kilobytes) != 1 || kilobytes < 0) {
+		printf(MEMORY_INVALID, kilobytes);
+		read_until_end(buffer);
+		return;
+	}
+	if (read_spaces()) read_until_end(buffer);
+	set_mem_budget((long long)kilobytes * 1024);
+}
+
+
+/**
+ * Handles the 'y' command.
+ * Answers a query from a snapshot of the system, writing its
+ * output to the given file while commands keep being processed.
+ */
+void exec_snapshot(system_t* sys, char* buffer) {
+	if (!read_spaces() || scanf("%s", buffer) != 1) {
+		printf(SNAPSHOT_INVALID);
+		return;
+	}
+	char* path = duplicate_string(buffer);
+	if (!read_spaces()) {
+		printf(SNAPSHOT_INVALID);
+		safe_free(path);
+		return;
+	}
+	read_until_end(buffer);
+	strcat(buffer, "\n");
+	char* line = duplicate_string(buffer);
+	if (!is_query_command(line[0]))
+		printf(SNAPSHOT_NOT_QUERY, line[0]);
+	else
+		run_snapshot(path, line, sys, buffer);
+	safe_free(line);
+	safe_free(path);
+}
+
+/**
+ * Handles the 'x' command.
+ * Exports the stays of a park, or of every park if no park name
+ * is given, that ended since the given watermark to a columnar
+ * file, showing the watermark of the next export.
+ */
+void exec_export(system_t* sys, char* buffer) {
+	park_t* park = NULL;
+	int watermark = 0, more;
+
+	if (!read_spaces() || scanf("%s", buffer) != 1) {
+		printf(EXPORT_INVALID);
+		return;
+	}
+	char* path = duplicate_string(buffer);
+	if (!(more = read_spaces()) || scanf("%d", &watermark) != 1 ||
+		watermark < 0) {
+		printf(EXPORT_INVALID_WATERMARK, watermark);
+		if (more) read_until_end(buffer);
+		safe_free(path);
+		return;
+	}
+	if ((more = read_spaces())) {
+		char* park_name = parse_allocate_name(buffer);
+		if (!park_name) {
+			printf(PARK_INVALID_NAME);
+			read_until_end(buffer);
+			safe_free(path);
+			return;
+		}
+		if (read_spaces()) read_until_end(buffer);
+		park = lookup_park(park_name, sys);
+		if (!park) printf(PARK_DOESNT_EXIST, park_name);
+		safe_free(park_name);
+	}
+	if (!more || park) run_export(path, park, watermark, sys);
+	safe_free(path);
+}
+
+/**
+ * Handles the 'a' command.
+ * Shows the vehicles parked for longer than the alert threshold,
+ * or sets the threshold in hours if one is given (0 for no alerts).
+ */
+void exec_alerts(system_t* sys, char* buffer) {
+	int hours = 0;
+	char extra;
+
+	if (!read_spaces()) {
+		// In router mode the clock may have moved in other workers
+		advance_alerts(sys->alerts, get_minute_index(sys->date_registry));
+		print_alerts(sys->alerts);
+		return;
+	}
+	// The threshold is shown as given, which may not be a number
+	if (scanf("%s", buffer) != 1 ||
+		sscanf(buffer, "%d%c", &hours, &extra) != 1 ||
+		hours < 0 || hours > ALERT_MAX_HOURS) {
+		printf(ALERT_INVALID, buffer);
+		read_until_end(buffer);
+		return;
+	}
+	if (read_spaces()) read_until_end(buffer);
+	set_alert_threshold(hours, sys);
+}
+
+/**
+ * Handles the 'i' command.
+ * Ingests the movements of several gate feeds at once,
+ * showing the rejected lines and a summary of each feed.
+ */
+void exec_gate_ingest(system_t* sys, char* buffer) {
+	char* paths[GATE_MAX_FEEDS];
+	int num_feeds = 0;
+
+	while (num_feeds < GATE_MAX_FEEDS && read_spaces() &&
+		scanf("%s", buffer) == 1) {
+		paths[num_feeds++] = duplicate_string(buffer);
+	}
+	if (num_feeds == GATE_MAX_FEEDS && read_spaces()) read_until_end(buffer);
+	if (!num_feeds) {
+		printf(GATE_NO_FEEDS);
+		return;
+	}
+	gate_ingest(paths, num_feeds, sys);
+	for (int i = 0; i < num_feeds; i++) {
+		safe_free(paths[i]);
+	}
 }
 
 
@@ -348,12 +996,12 @@ void exec_remove_park(system_t* sys, char* buffer) {
 /**
  * Parses a name from the provided buffer, allocates memory for it, 
  * and copies it into the newly allocated string.
+ * Returns NULL, allocating nothing, if the name is invalid.
 */
 char* parse_allocate_name(char* buffer) {
     int name_len = read_name(buffer);
-	char* invalid = "invalid";
 	if (name_len == -1) {
-		return invalid;
+		return NULL;
 	}
     char* name = safe_malloc(name_len * sizeof(char));
     memcpy(name, buffer, name_len);
@@ -365,9 +1013,8 @@ char* parse_allocate_name(char* buffer) {
  * Reads the text until the end of the line.
 */
 void read_until_end(char* s) {
-	char c;
-	int i = 0;
-	while ((c = getchar()) != '\n') {
+	int c, i = 0;
+	while ((c = getchar()) != '\n' && c != EOF) {
 		s[i++] = c;
 	}
 	s[i] = '\0';
@@ -384,7 +1031,8 @@ int read_name(char* s) {
 	}
 	if (s[0] != '"') {
 		i = 1;
-		while ((c = getchar()) != ' ' && c != '\t' && c != '\n') {
+		while ((c = getchar()) != ' ' && c != '\t' && c != '\n' &&
+			c != EOF) {
 			if (c >= '0' && c <= '9') {
 				s[i++] = '\0';
 				return -1;
@@ -393,7 +1041,7 @@ int read_name(char* s) {
 		}
 		ungetc(c, stdin);
 	} else {
-		while ((c = getchar()) != '"') {
+		while ((c = getchar()) != '"' && c != EOF) {
 			if (c >= '0' && c <= '9') {
 				s[i++] = '\0';
 				return -1;
@@ -405,6 +1053,27 @@ int read_name(char* s) {
 	return i;
 }
 
+/**
+ * Reads a date in the dd-mm-yyyy format, setting its hour to 00:00.
+ * Returns TRUE if the date was read, FALSE otherwise.
+*/
+int read_date(timestamp_t* date) {
+	if (scanf("%02d-%02d-%4d", &date->d, &date->mth, &date->y) != 3)
+		return FALSE;
+	date->h = 0;
+	date->min = 0;
+	return TRUE;
+}
+
+/**
+ * Reads a date and time in the dd-mm-yyyy hh:mm format.
+ * Returns TRUE if the date and time were read, FALSE otherwise.
+*/
+int read_date_time(timestamp_t* date) {
+	return scanf("%02d-%02d-%4d %02d:%02d", &date->d, &date->mth,
+		 &date->y, &date->h, &date->min) == 5;
+}
+
 /**
  * Reads spaces. Returns 0 if it has reached the end of line, 1 otherwise.
 */
@@ -450,19 +1119,6 @@ char* duplicate_string(const char* str) {
 }
 
 
-/**
- * A safe version of malloc that stops the program if no memory
- * is available.
- */
-void *safe_malloc(unsigned size) {
-	void *ptr = malloc(size);
-	if(!ptr) {
-		printf("No memory.");
-		exit(EXIT_FAILURE);
-	}
-	return ptr;
-}
-
 /**
  * Frees the parks list of the system struct, 
  * freeing the park name
@@ -474,40 +1130,55 @@ void free_parks(list_t* parks) {
         park_t* park = (park_t*)current->val;
         delete_list(park->park_entries);
         delete_list(park->park_exits);
+        delete_list(park->open_entries);
+		free_fenwick(park->revenue_idx);
+		free_series(park->occupancy);
+		free_daily(park->visitors);
+		free_daily(park->durations);
+		free_stay_index(park->stays);
+		safe_free(park->top_paid);
+		safe_free(park->top_visits);
 
 		node_t* next = park->park_vehicles->head;
     	while(next != NULL) {
 			node_t* aux = next;
 			next = aux->next;
 			
-			free(aux);
+			if (park->history)
+				safe_free(((vehicle_t*)aux->val)->current_entry);
+			safe_free(aux);
 		}
-    	free(park->park_vehicles);
-		free(park->park_name);
+		if (park->history)
+			free_history(park->history);
+		delete_list(park->day_totals);
+    	safe_free(park->park_vehicles);
+		safe_free(park->park_name);
 
         temp = current->next;
 
-        free(current); 
+        safe_free(current); 
         current = temp;
     }
-    free(parks);
+    safe_free(parks);
 }
 
 /**
  * 
 */
 void free_hashtable(hash_table* hashtable) {
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
+    for (int i = 0; i < hashtable->size; i++) {
         node_h* current = hashtable->table[i];
         while (current != NULL) {
             node_h* temp = current;
 			vehicle_t* vhc = (vehicle_t*)temp->vehicle;
             current = current->next;
-			free(vhc);
-            free(temp);
+			free_vehicle_stats(vhc);
+			safe_free(vhc);
+            safe_free(temp);
         }
     }
-    free(hashtable);
+    safe_free(hashtable->table);
+    safe_free(hashtable);
 }
 
 
@@ -517,9 +1188,16 @@ void free_hashtable(hash_table* hashtable) {
  * is freed here, including the auxiliar buffer.
 */
 void free_mem(system_t* sys, char* buffer) {
+	free_events(sys);
+	free_alerts(sys->alerts);
     free_parks(sys->parks);
-	delete_list(sys->srtd_parks);
+	delete_skiplist(sys->srtd_parks);
 	free_hashtable(sys->vhc_ht);
-	free(buffer);
-    free(sys);
+	free_fenwick(sys->revenue_idx);
+	safe_free(sys->top_paid);
+	safe_free(sys->top_visits);
+	safe_free(sys->vehicle_ids);
+	free_query_cache(sys->cache);
+	safe_free(buffer);
+    safe_free(sys);
 }
\ No newline at end of file
@@ -11,6 +11,9 @@
 #ifndef PROJECT_H
 #define PROJECT_H
 
+#include <stdio.h> /* FILE, for the router's pipes */
+#include <pthread.h> /* locks of the gate feeds */
+
 /* constant values */
 
 #define TRUE 1
@@ -35,6 +38,23 @@
 #define FACT_COMMAND 'f'
 #define REMOVE_COMMAND 'r'
 #define PAID_COMAMND 'u'
+#define OCCUPANTS_COMMAND 'l'
+#define REVENUE_COMMAND 'g'
+#define OCCUPANCY_COMMAND 'o'
+#define TOP_COMMAND 't'
+#define RETENTION_COMMAND 'k'
+#define DIRECTORY_COMMAND 'n'
+#define BULK_COMMAND 'b'
+#define MEMORY_COMMAND 'm'
+#define SNAPSHOT_COMMAND 'y'
+#define GATES_COMMAND 'i'
+#define VISITORS_COMMAND 'h'
+#define DURATIONS_COMMAND 'd'
+#define EXPORT_COMMAND 'x'
+#define ALERT_COMMAND 'a'
+#define PRESENT_COMMAND 'w'
+#define REPORT_COMMAND 'c'
+#define SUBSCRIBE_COMMAND 'z'
 
 /* struct calls to use in other structs */
 
@@ -42,6 +62,12 @@ typedef struct entry_t entry_t;
 
 typedef struct vehicle_t vehicle_t;
 
+typedef struct park_t park_t;
+
+typedef struct gate_ingest_t gate_ingest_t;
+
+typedef struct alert_t alert_t;
+
 /* timestamps and tariffs */
 
 typedef struct {
@@ -67,17 +93,316 @@ typedef struct list {
 	node_t* tail;
 } list_t;
 
+/* skiplist, ordered by string key */
+
+#define SKIPLIST_MAX_LEVEL 16
+
+typedef struct skip_node {
+	char* key;
+	void* val;
+	int level;
+	struct skip_node* next[SKIPLIST_MAX_LEVEL];
+} skip_node_t;
+
+typedef struct {
+	skip_node_t* head;
+	int level;
+	unsigned seed; /* state of the level generator */
+} skiplist_t;
+
+/* fenwick tree (binary indexed tree) of integer sums */
+
+#define FENWICK_INIT_SIZE 64
+
+typedef struct {
+	long long* tree;
+	int size; /* always a power of two */
+} fenwick_t;
+
+/* array of a bucket per day, each created on the first use of its day */
+
+#define DAILY_INIT_DAYS 32
+
+typedef struct {
+	void** days; /* bucket of each day, or NULL */
+	int size;
+	int bucket_bytes;
+} daily_t;
+
+/* occupancy time series, delta encoded in fixed size blocks */
+
+#define SERIES_BLOCK_BYTES 120
+#define SERIES_MAX_POINT_BYTES 10
+#define SERIES_INIT_BLOCKS 4
+
+typedef struct {
+	int base_time; /* minute of the first point of the block */
+	int base_occupancy;
+	int last_time;
+	int last_occupancy;
+	int max_occupancy;
+	int used; /* bytes of data in use */
+	long long base_area; /* vehicle minutes up to base_time */
+	long long last_area; /* vehicle minutes up to last_time */
+	unsigned char data[SERIES_BLOCK_BYTES];
+} series_block_t;
+
+typedef struct {
+	series_block_t* blocks;
+	int num_blocks;
+	int capacity;
+} occupancy_series_t;
+
+/* distinct vehicles of each day, as hyperloglog sketches */
+
+#define HLL_PRECISION 10 /* bits of the hash that pick the register */
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+typedef struct {
+	unsigned char registers[HLL_REGISTERS];
+} hll_t;
+
+/* stay lengths of each day, as log bucketed histograms */
+
+#define DURATION_SUB_BITS 3 /* linear buckets per power of two: 8 */
+#define DURATION_MAX_LOG 20 /* longer stays share the last bucket */
+#define DURATION_BUCKETS \
+ ((DURATION_MAX_LOG - DURATION_SUB_BITS + 2) << DURATION_SUB_BITS)
+
+typedef struct {
+	int counts[DURATION_BUCKETS]; /* stays whose minutes fall in a bucket */
+} duration_histogram_t;
+
+/* compact movement history, kept as completed stays in exit order */
+
+#define HISTORY_BLOCK_BYTES 240
+#define HISTORY_MAX_RECORD_BYTES 20
+#define HISTORY_INIT_BLOCKS 4
+#define COMPACT_HISTORY_OPTION "-c"
+
+typedef struct {
+	int base_exit; /* minute the exit of the first stay counts from */
+	int last_exit;
+	int count;
+	int used; /* bytes of data in use */
+	unsigned char data[HISTORY_BLOCK_BYTES];
+} history_block_t;
+
+/* entries before a minute aged out from the stays appended by then */
+typedef struct {
+	int end_stay;
+	int before;
+} history_horizon_t;
+
+typedef struct {
+	history_block_t* blocks;
+	int num_blocks;
+	int capacity;
+	int first_stay; /* number of stays aged out, and of appended ones */
+	int num_stays;
+	history_horizon_t* horizons; /* older stays first, by older minute */
+	int num_horizons;
+	int max_horizons;
+	int min_entry; /* earliest entry of the stays after the horizons */
+} history_t;
+
+typedef struct {
+	vehicle_t* vehicle;
+	int entry_time; /* minute indexes */
+	int exit_time;
+	long long cents;
+} stay_t;
+
+typedef struct {
+	history_t* history;
+	int block;
+	int pos;
+	int time; /* exit minute of the last decoded stay */
+} history_iter_t;
+
+/* index of the completed stays of a park, for who was there when */
+
+#define STAY_INDEX_INIT 64
+
+typedef struct {
+	int entry_time; /* minute indexes */
+	int exit_time;
+	int vehicle_id;
+} closed_stay_t;
+
+typedef struct {
+	closed_stay_t* stays; /* in exit order */
+	int* min_entry; /* segment tree of the earliest entry, leaves last */
+	int first; /* stays before it were aged out */
+	int size;
+	int capacity; /* a power of two */
+	int horizon; /* minute before which stays were aged out */
+} stay_index_t;
+
+typedef struct {
+	vehicle_t* vehicle;
+	int entry_time;
+	int exit_time; /* -1 while parked */
+} present_t;
+
+/* retention of old movements */
+
+#define RETENTION_STEP 32
+#define RETENTION_INVALID "%d: invalid retention.\n"
+#define VEHICLE_AGED_OUT "%s: %d older stays aged out.\n"
+#define FACT_AGED_OUT "%02d-%02d-%4d: detail aged out.\n"
+
+typedef struct {
+	int day;
+	long long cents;
+} day_total_t;
+
+/* memory budget */
+
+#define MEMORY_BUDGET_OPTION "-m"
+#define MEMORY_RESERVE 4096 /* bytes kept free for one command */
+#define MEM_VEHICLES 0
+#define MEM_ENTRIES 1
+#define MEM_EXITS 2
+#define MEM_PARKS 3
+#define MEM_HISTORY 4
+#define MEM_OTHER 5
+#define MEM_CACHE 6
+#define MEM_ALERTS 7
+#define MEM_SUBSYSTEMS 8
+#define MEMORY_BUDGET_EXCEEDED "memory budget exceeded.\n"
+#define MEMORY_INVALID "%d: invalid memory budget.\n"
+
+/* placed before every allocation */
+typedef union {
+	struct {
+		unsigned int size;
+		int tag; /* subsystem the allocation is charged to */
+	} info;
+	long double align; /* keeps the memory after it aligned */
+} mem_header_t;
+
+typedef struct {
+	long long used[MEM_SUBSYSTEMS]; /* bytes, headers included */
+	long long peak;
+	long long budget; /* bytes, 0 for no budget */
+	long long reclaimed; /* bytes given back to stay in budget */
+	long long allocations; /* calls to safe_malloc and safe_realloc */
+} mem_account_t;
+
+/* snapshots for queries */
+
+#define SNAPSHOT_QUERIES "vfulgotnmhdawc"
+#define SNAPSHOT_NO_FILE "%s: cannot open file.\n"
+#define SNAPSHOT_NOT_QUERY "%c: not a query.\n"
+#define SNAPSHOT_FAILED "snapshot failed.\n"
+#define SNAPSHOT_INVALID "invalid snapshot.\n"
+
+/* columnar export of completed stays */
+
+#define EXPORT_MAGIC "PKCX"
+#define EXPORT_VERSION 1
+#define EXPORT_COLUMNS 5
+#define EXPORT_CHUNK_ROWS 4096
+#define EXPORT_PLATE 0 /* plate characters, big endian */
+#define EXPORT_ENTRY 1 /* minute indexes */
+#define EXPORT_EXIT 2
+#define EXPORT_CENTS 3
+#define EXPORT_PARK 4
+#define EXPORT_INVALID "invalid export.\n"
+#define EXPORT_INVALID_WATERMARK "%d: invalid watermark.\n"
+#define EXPORT_WATERMARK "watermark %d\n"
+
+typedef struct {
+	FILE* out;
+	long long values[EXPORT_COLUMNS][EXPORT_CHUNK_ROWS];
+	int rows; /* rows of the chunk being filled */
+	long long total;
+} export_chunk_t;
+
+/* bulk loading of movements */
+
+#define BULK_CHUNK 4096
+#define BULK_PLATE_SIZE 16
+#define BULK_INVALID_LINE 10
+#define BULK_INVALID_NAME 11
+#define BULK_NO_PARK 12
+#define BULK_NO_FILE "%s: no such file.\n"
+#define BULK_REJECTED_LINE "line %d: "
+#define BULK_INVALID_MOVEMENT "invalid movement.\n"
+#define BULK_SUMMARY "%d movements loaded, %d rejected.\n"
+
+typedef struct {
+	int line;
+	char op;
+	int error; /* parse error, or MOVEMENT_OK */
+	char plate[BULK_PLATE_SIZE];
+	char* park_name;
+	timestamp_t date;
+	char* source; /* file of a line of a merge of several, or NULL */
+} bulk_record_t;
+
+typedef struct {
+	int size;
+	bulk_record_t recs[BULK_CHUNK];
+	char valid_plate[BULK_CHUNK];
+	char valid_date[BULK_CHUNK];
+	int mins[BULK_CHUNK];
+	char* plates[BULK_CHUNK];
+	vehicle_t* vehicles[BULK_CHUNK]; /* resolved in one batch, or NULL */
+} bulk_chunk_t;
+
+typedef struct {
+	int loaded;
+	int rejected;
+} bulk_stats_t;
+
+/* merge of several files of movements by minute */
+
+#define MERGE_MAX_FEEDS 16
+#define MERGE_BLOCK 65536 /* bytes read from a file at a time */
+#define MERGE_SOURCE "%s: "
+
+typedef struct {
+	char* path;
+	FILE* file;
+	char* block; /* buffer of the file */
+	char* line; /* next line of the file */
+	int line_num;
+	int key; /* minute of the next line */
+	bulk_record_t rec; /* the next line, parsed */
+} merge_feed_t;
+
+typedef struct {
+	merge_feed_t feeds[MERGE_MAX_FEEDS];
+	int num_feeds;
+	int heap[MERGE_MAX_FEEDS]; /* files with lines left, next line first */
+	int size;
+	int last; /* file of the line returned last, or INVALID */
+	char* name; /* scratch space for park names */
+} merge_t;
+
 /* hashtable */
 
-#define HASH_TABLE_SIZE 293
+#define HASH_TABLE_SIZE 256 /* initial number of buckets, a power of 2 */
+#define HT_BATCH 16 /* lookups search_ht_batch keeps in flight */
+
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
 
 typedef struct node_h {
     vehicle_t* vehicle;
+    unsigned int hash; /* full hash of the plate, checked before it */
     struct node_h* next;
 } node_h;
 
 typedef struct hash_table {
-    node_h* table[HASH_TABLE_SIZE];
+    node_h** table;
+    int size; /* power of 2, doubled when count goes past it */
+    int count;
 } hash_table;
 
 
@@ -91,25 +416,91 @@ typedef struct hash_table {
 #define VEHICLE_NO_REGISTRY "%s: no entries found in any parking.\n"
 #define INVALID_DATE "invalid date.\n"
 
+#define MOVEMENT_OK 0
+#define MOVEMENT_INVALID_DATE 1
+#define MOVEMENT_PARK_FULL 2
+#define MOVEMENT_INVALID_PLATE 3
+#define MOVEMENT_INVALID_ENTRY 4
+#define MOVEMENT_INVALID_EXIT 5
+#define MOVEMENT_NO_MEMORY 6
+
+/* what a vehicle has paid and how many stays it made in one park */
+typedef struct vehicle_stats_t {
+	park_t* park;
+	long long cents;
+	int visits;
+	struct vehicle_stats_t* next;
+} vehicle_stats_t;
+
 struct vehicle_t {
 	char license_plate[V_LICENSE_PLT_LENGTH];
 	timestamp_t last_entry;
 	entry_t* current_entry;
+	node_t* park_node; /* slot in the current park's park_vehicles */
+	long long total_cents;
+	int total_visits;
+	vehicle_stats_t* park_stats;
+	int id; /* dictionary code used by the compact history */
+	unsigned int version; /* bumped by its movements, for the query cache */
+	alert_t* alert; /* overstay timer while parked, or NULL */
 };
 
 struct entry_t {
-	char *park_name;
+	int park_id;
 	vehicle_t* vehicle;
 	timestamp_t entry_date_time;
+	node_t* open_node; /* slot in the park's open_entries once aged, or NULL */
 };
 
 typedef struct {
-	char *park_name;
+	int park_id;
+	int entry_time; /* minute index of the entry of the stay */
 	vehicle_t* vehicle;
 	timestamp_t exit_date_time;
 	float paid_value;
 } exit_t;
 
+/* overstay alerts, kept in a hierarchical timing wheel */
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4 /* deadlines up to 2^24 minutes ahead */
+#define ALERT_MAX_HOURS 8760
+#define ALERT_INVALID "%s: invalid threshold.\n"
+
+struct alert_t {
+	vehicle_t* vehicle;
+	park_t* park;
+	int deadline; /* minute index at which the vehicle overstays */
+	int level; /* level of the wheel it waits in, -1 once it fired */
+	list_t* list; /* slot or list of overstaying vehicles it is in */
+	node_t* node;
+};
+
+typedef struct {
+	list_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	int counts[WHEEL_LEVELS]; /* timers waiting in each level */
+	int now; /* minute index up to which timers fired */
+	int threshold; /* minutes, 0 for no alerts */
+	list_t overstaying; /* fired timers, in order of firing */
+	int num_overstaying;
+} timing_wheel_t;
+
+/* leaderboards of the best vehicles by paid value or visits */
+
+#define TOPK_MAX 100
+#define TOPK_INVALID_COUNT "%d: invalid count.\n"
+
+typedef struct {
+	vehicle_t* vehicle;
+	long long score;
+} ranked_t;
+
+typedef struct {
+	ranked_t ranks[TOPK_MAX];
+	int size;
+} leaderboard_t;
+
 /* car parks */
 
 #define PARK_DUPLICATE "%s: parking already exists.\n"
@@ -118,24 +509,223 @@ typedef struct {
 #define PARK_INVALID_TARIFARY "invalid cost.\n"
 #define PARK_MAX_EXCEEDED "too many parks.\n"
 
-typedef struct {
+struct park_t {
 	char *park_name;
+	int id; /* slot in the system's park_ids, reused after removal */
+	node_t* parks_node; /* slot in the system's parks list */
 	int park_capacity;
 	int num_vehicles;
 	tariff_t park_tariff;
 	list_t *park_entries;
 	list_t *park_exits;
+	list_t *open_entries; /* aged out entries of the vehicles still inside */
 	list_t *park_vehicles;
-} park_t;
+	fenwick_t *revenue_idx; /* cents paid, bucketed by exit day */
+	occupancy_series_t *occupancy;
+	leaderboard_t *top_paid;
+	leaderboard_t *top_visits;
+	history_t *history; /* replaces the entry and exit lists if set */
+	list_t *day_totals; /* revenue of the days that were aged out */
+	daily_t *visitors; /* hll_t of the vehicles entering, by day */
+	daily_t *durations; /* duration_histogram_t of the exits, by day */
+	stay_index_t *stays; /* completed stays, by the time they overlap */
+	unsigned int version; /* bumped by its movements, for the query cache */
+};
+
+/* cache of query results */
+
+#define QUERY_CACHE_SIZE 64 /* results kept */
+#define QUERY_CACHE_BYTES 262144 /* bytes of results kept */
+
+typedef struct {
+	unsigned int hash;
+	char* key; /* the query, as typed with its arguments parsed */
+	char* result; /* what the query printed */
+	int len;
+	unsigned int version; /* of the park or vehicle the result depends on */
+	unsigned int epoch; /* of the cache when the result was stored */
+	node_t* node; /* slot in the cache's recency list */
+} cached_query_t;
+
+typedef struct {
+	list_t* entries; /* least recently used first */
+	int size;
+	long long bytes;
+	unsigned int epoch; /* bumped to drop every result at once */
+	long long hits;
+	long long misses;
+	FILE* saved_stdout; /* while the output of a query is captured */
+	char* capture;
+	size_t capture_len;
+} query_cache_t;
+
+/* stream of occupancy changes */
+
+#define EVENTS_RING 1024 /* a power of 2 */
+#define EVENTS_MAX_SUBSCRIBERS 16
+#define EVENTS_CLOSE_WAIT 1000 /* ms a subscriber is waited for at the end */
+#define EVENTS_LINE_SIZE (MAX_LINE_SIZE + 16)
+#define EVENTS_INVALID "invalid subscription.\n"
+#define EVENTS_TOO_MANY "too many subscribers.\n"
+
+typedef struct {
+	unsigned int sequence; /* position it holds an event for, plus 1 */
+	int park_id;
+	int free;
+} occupancy_event_t;
+
+typedef struct {
+	char* path;
+	int fd;
+	int park_id; /* INVALID for every park */
+	int closed; /* the other end went away */
+	char pending[EVENTS_LINE_SIZE]; /* rest of a line not taken yet */
+	int pending_len;
+	char changed[MAX_P]; /* parks to send once it catches up */
+	int num_changed;
+} subscriber_t;
+
+typedef struct {
+	occupancy_event_t ring[EVENTS_RING];
+	unsigned int head; /* next position to read */
+	unsigned int tail; /* next position to claim */
+	char missed[MAX_P]; /* parks that changed with the ring full */
+	char any_missed;
+	subscriber_t subscribers[EVENTS_MAX_SUBSCRIBERS];
+	int num_subscribers;
+} event_stream_t;
+
+/* router mode */
+
+#define ROUTER_OPTION "-w"
+#define MAX_SHARDS 16
+#define ROUTER_CONTEXT '\x1c' /* state a worker cannot see by itself */
+#define ROUTER_BULK_LINE '\x1b' /* one line of a bulk load */
+#define ROUTER_TOTALS '\x1e' /* dump of the totals of every vehicle */
+#define ROUTER_STATUS '\x1d' /* ends the answer of a worker */
+#define ROUTER_SKETCH '\x1f' /* 'h' or 'd' answered with raw sketches */
+#define ROUTER_RETENTION '\x1a' /* a step of aging out, over some parks */
+#define ROUTER_INVALID_SHARDS "%d: invalid number of workers.\n"
+#define ROUTER_FAILED "cannot start workers.\n"
+
+typedef struct {
+	int pid;
+	FILE* requests;
+	FILE* answers;
+	char* answer; /* output of the last request */
+	int answer_len;
+	int answer_capacity;
+	timestamp_t date_registry; /* state reported after the last request */
+	int num_parks;
+	long long num_movements;
+	int all_subscribers; /* subscribed to every park */
+	int park_subscribers; /* subscribed to one park of the worker */
+} shard_t;
+
+typedef struct {
+	int num_shards;
+	shard_t shards[MAX_SHARDS];
+	char* park_names[MAX_P]; /* in order of creation */
+	int park_shards[MAX_P];
+	int park_serials[MAX_P];
+	int num_parks;
+	int next_serial;
+	int retention_days; /* as set in the workers, 0 keeps everything */
+	int retention_next; /* park the next step of aging out starts at */
+	timestamp_t date_registry;
+	hash_table* vehicles; /* id is the serial of the park it is in, or -1 */
+} router_t;
 
 /* system */
 
 typedef struct {
 	list_t *parks;
-	list_t *srtd_parks;
+	skiplist_t *srtd_parks; /* parks ordered by name */
+	park_t *park_ids[MAX_P]; /* parks indexed by their id */
+	int park_rank[MAX_P]; /* position of each park id in name order */
 	int num_parks;
 	hash_table* vhc_ht;
 	timestamp_t date_registry;
+	fenwick_t *revenue_idx; /* cents paid in every park, by exit day */
+	leaderboard_t *top_paid;
+	leaderboard_t *top_visits;
+	vehicle_t **vehicle_ids; /* vehicles indexed by their id */
+	int num_vehicles;
+	int vehicle_ids_capacity;
+	int compact_history;
+	int retention_days; /* 0 keeps every movement */
+	int retention_next; /* park the next step of aging out starts at */
+	int bulk_loading; /* movements are applied without output */
+	long long num_movements; /* entries and exits registered */
+	int num_shards; /* worker processes of the router mode, or 0 */
+	int entry_elsewhere; /* the next entry's vehicle is in another worker */
+	gate_ingest_t *gates; /* set while gate feeds are ingested */
+	query_cache_t *cache; /* results of repeated queries */
+	timing_wheel_t *alerts; /* vehicles parked longer than a threshold */
+	int raw_sketches; /* 'h' and 'd' print sketches for the router to merge */
+	int binary_protocol; /* movements come and go as binary records */
+	event_stream_t *events; /* occupancy changes for subscribers */
 } system_t;
 
+/* concurrent ingest of gate feeds */
+
+#define GATE_MAX_FEEDS 16
+#define GATE_VEHICLE_LOCKS 64 /* a power of 2 */
+#define GATE_NO_FEEDS "no gate feeds.\n"
+#define GATE_SUMMARY "%s: %d movements loaded, %d rejected.\n"
+
+struct gate_ingest_t {
+	system_t* sys;
+	int last_minute; /* the sequencer: minute of the latest movement */
+	pthread_mutex_t system_lock; /* vehicle table and system totals */
+	pthread_mutex_t park_locks[MAX_P]; /* by park id */
+	pthread_mutex_t vehicle_locks[GATE_VEHICLE_LOCKS]; /* by plate hash */
+};
+
+typedef struct {
+	char* path;
+	FILE* file; /* NULL if it could not be opened */
+	gate_ingest_t* ingest;
+	bulk_record_t* rejects; /* with the reason in their error */
+	int num_rejects;
+	int rejects_capacity;
+	bulk_stats_t stats;
+	pthread_t thread;
+} gate_feed_t;
+
+/* revenue report of every park */
+
+#define REPORT_THREADS 4
+#define REPORT_INIT_FARES 64
+
+typedef struct {
+	park_t* park;
+	int* days; /* day of each fare, then of each daily total */
+	long long* fares; /* cents of each fare, then of each day */
+	int num_fares;
+	int capacity;
+	long long total;
+} park_report_t;
+
+typedef struct {
+	system_t* sys;
+	park_report_t* parks; /* in name order */
+	int num_parks;
+	int next; /* next park no thread took yet */
+} revenue_report_t;
+
+/* binary protocol of the gate controllers */
+
+#define BINARY_OPTION "-b"
+#define BINARY_ENTRY '\x01'
+#define BINARY_EXIT '\x02'
+#define BINARY_RECORD_SIZE 16
+#define BINARY_WITH_ROUTER "binary protocol not available with workers.\n"
+
+typedef struct {
+	int status; /* MOVEMENT_OK or why it was rejected */
+	int entry_time;
+	long long value; /* free spots after an entry, cents paid on an exit */
+} binary_reply_t;
+
 #endif
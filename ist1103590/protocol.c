@@ -0,0 +1,120 @@
+/**
+ * @file protocol.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the binary protocol of the gate controllers,
+ * turned on by the -b option. Entries and exits come as records
+ * of fixed size instead of 'e' and 's' lines, so no name, plate
+ * or date has to be parsed, and each is answered by a record of
+ * fixed size too. Any other byte starts a text command as usual,
+ * so parks are still created and queried in text.
+ *
+ * Every number is little endian. A request has its opcode, a
+ * zero byte and the id of its park (2 bytes), the 8 characters
+ * of the license plate and the minute of the movement since
+ * 01-01-2024 00:00 (4 bytes). Parks take the lowest free id when
+ * created, starting from 0. A reply has the opcode, the status
+ * (MOVEMENT_OK, the reason why the movement was rejected, or
+ * BULK_NO_PARK), the id of the park (2 bytes), the minute of the
+ * entry (4 bytes) and a value (8 bytes): the free spots of the
+ * park after an entry, or the cents paid on an exit.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/**
+ * Returns the number in the given bytes, little endian.
+*/
+long long read_le(unsigned char* bytes, int width) {
+    unsigned long long value = 0;
+    for (int i = width - 1; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return (long long)value;
+}
+
+/**
+ * Checks and applies a movement request, as the 'e' and 's'
+ * commands would, filling its reply instead of printing.
+*/
+void binary_movement(unsigned char* request, binary_reply_t* reply,
+                       system_t* sys) {
+    char plate[V_LICENSE_PLT_LENGTH];
+    int park_id = (int)read_le(request + 2, 2);
+    int minute = (int)read_le(request + 12, 4);
+    int is_entry = request[0] == BINARY_ENTRY;
+    park_t* park = park_id < MAX_P ? sys->park_ids[park_id] : NULL;
+
+    memcpy(plate, request + 4, V_LICENSE_PLT_LENGTH - 1);
+    plate[V_LICENSE_PLT_LENGTH - 1] = '\0';
+    reply->entry_time = 0;
+    reply->value = 0;
+    if (!park) {
+        reply->status = BULK_NO_PARK;
+        return;
+    }
+    timestamp_t date = minute_to_timestamp(minute < 0 ? 0 : minute);
+    reply->status = minute < 0 ? MOVEMENT_INVALID_DATE :
+     movement_error(park, plate, date, sys, is_entry);
+    if (reply->status != MOVEMENT_OK) return;
+
+    // The movement is the latest one, as in a bulk load
+    sys->bulk_loading = TRUE;
+    if (is_entry) {
+        register_entry(park, plate, date, sys);
+        reply->entry_time = minute;
+        reply->value = park->park_capacity - park->num_vehicles;
+    } else {
+        vehicle_t* vhc = search_ht(sys->vhc_ht, plate);
+        reply->entry_time = get_minute_index(vhc->last_entry);
+        reply->value = to_cents(calculate_facturation(vhc->last_entry,
+         date, park->park_tariff));
+        register_exit(park, plate, date, sys);
+    }
+    sys->bulk_loading = FALSE;
+    retention_step(sys);
+}
+
+/**
+ * Writes the reply to a movement request.
+*/
+void write_reply(unsigned char* request, binary_reply_t* reply) {
+    fputc(request[0], stdout);
+    fputc(reply->status, stdout);
+    fwrite(request + 2, 1, 2, stdout);
+    write_le(stdout, reply->entry_time, 4);
+    write_le(stdout, reply->value, 8);
+}
+
+/**
+ * Reads commands until the end of the input or a 'q' command,
+ * answering movement requests in binary and the rest in text.
+ * A request cut short by the end of the input is ignored.
+*/
+void run_binary(system_t* sys, char* buffer) {
+    unsigned char request[BINARY_RECORD_SIZE];
+    binary_reply_t reply;
+    int c;
+
+    while ((c = getchar()) != EOF) {
+        if (c != BINARY_ENTRY && c != BINARY_EXIT) {
+            if (!command_processor(c, sys, buffer)) break;
+            pump_events(sys);
+            continue;
+        }
+        request[0] = (unsigned char)c;
+        if (fread(request + 1, 1, BINARY_RECORD_SIZE - 1, stdin) !=
+            BINARY_RECORD_SIZE - 1)
+            break;
+        binary_movement(request, &reply, sys);
+        write_reply(request, &reply);
+        pump_events(sys);
+    }
+}
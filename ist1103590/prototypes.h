@@ -18,6 +18,8 @@
 /* project.c */
 /*************/
 
+void parse_options(int argc, char* argv[], system_t* sys);
+
 system_t* init_system();
 
 int command_processor(char command, system_t* sys, char* buffer);
@@ -36,6 +38,50 @@ void exec_park_facturation(system_t* sys, char* buffer);
 
 void exec_remove_park(system_t* sys, char* buffer);
 
+void exec_list_park_vehicles(system_t* sys, char* buffer);
+
+int read_range_query(system_t* sys, char* buffer, park_t** park,
+ timestamp_t* from, timestamp_t* to);
+
+void exec_revenue_query(system_t* sys, char* buffer);
+
+void exec_distinct_vehicles(system_t* sys, char* buffer);
+
+void exec_stay_durations(system_t* sys, char* buffer);
+
+int read_instant_query(system_t* sys, char* buffer, park_t** park,
+ timestamp_t* from, timestamp_t* to, int* is_range);
+
+void exec_occupancy_query(system_t* sys, char* buffer);
+
+void exec_present_vehicles(system_t* sys, char* buffer);
+
+void exec_revenue_report(system_t* sys, char* buffer);
+
+void exec_subscribe(system_t* sys, char* buffer);
+
+void exec_show_leaderboards(system_t* sys, char* buffer);
+
+void exec_set_retention(system_t* sys, char* buffer);
+
+void exec_park_directory(system_t* sys, char* buffer);
+
+void exec_bulk_load(system_t* sys, char* buffer);
+
+void exec_memory(system_t* sys, char* buffer);
+
+void exec_snapshot(system_t* sys, char* buffer);
+
+void exec_gate_ingest(system_t* sys, char* buffer);
+
+void exec_export(system_t* sys, char* buffer);
+
+void exec_alerts(system_t* sys, char* buffer);
+
+int read_date_time(timestamp_t* date);
+
+int read_date(timestamp_t* date);
+
 char* parse_allocate_name(char* buffer);
 
 void read_until_end(char* s);
@@ -50,14 +96,38 @@ int is_digit(char c);
 
 char *duplicate_string(const char* str);
 
-void *safe_malloc(unsigned size);
-
 void free_parks(list_t* parks);
 
 void free_hashtable(hash_table* hashtable);
 
 void free_mem(system_t* sys, char* buffer);
 
+/************/
+/* memory.c */
+/************/
+
+int mem_scope(int tag);
+
+void mem_charge(int tag, long long bytes);
+
+void *safe_malloc(unsigned size);
+
+void *safe_realloc(void* ptr, unsigned size);
+
+void safe_free(void* ptr);
+
+long long mem_total();
+
+long long mem_allocations();
+
+void set_mem_budget(long long bytes);
+
+int memory_fits();
+
+int memory_admits(system_t* sys);
+
+void print_memory_report();
+
 /***********/
 /* parks.c */
 /***********/
@@ -67,6 +137,10 @@ void create_parking(char* name, int capacity,
 
 void list_parks(system_t* sys);
 
+void update_park_ranks(system_t* sys);
+
+void print_park(park_t* p);
+
 void remove_parks(park_t* park, system_t* sys);
 
 int invalid_park_args(char* park_name, int capacity, 
@@ -74,6 +148,12 @@ int invalid_park_args(char* park_name, int capacity,
 
 park_t* lookup_park(char* park_name, system_t* sys);
 
+void list_park_vehicles(park_t* park);
+
+void list_parks_by_prefix(char* prefix, system_t* sys);
+
+void list_parks_in_range(char* from, char* to, system_t* sys);
+
 /***************/
 /* movements.c */
 /***************/
@@ -87,16 +167,15 @@ void register_exit(park_t* park, char* license_plate,
 int invalid_movement_args(park_t* park, char* license_plate,
  timestamp_t date, system_t* sys, int is_entry);
 
-int validate_movement_date(timestamp_t date, system_t* sys);
-
-int validate_entry_park_capacity(park_t* park, int is_entry);
+int movement_error(park_t* park, char* license_plate,
+ timestamp_t date, system_t* sys, int is_entry);
 
-int validate_license_plate(char* license_plate);
+int movement_state_error(park_t* park, vehicle_t* vhc,
+ int valid_plate, int is_entry, system_t* sys);
 
-int validate_vehicle_entry(vehicle_t* vhc, int is_entry);
+void print_movement_error(int error, park_t* park, char* license_plate);
 
-int validate_vehicle_exit(vehicle_t* vhc, int is_entry,
- park_t* park, char* license_plate);
+int validate_license_plate(char* license_plate);
 
 float calculate_facturation(timestamp_t entry,
  timestamp_t exit, tariff_t tariff);
@@ -107,8 +186,170 @@ int invalid_factdate_args(timestamp_t facturation_date,
 void print_facturation_by_day(park_t* park,
     timestamp_t facturation_date);
 
+int print_aged_out_day(park_t* park, timestamp_t facturation_date);
+
 void print_facturation(park_t* park);
 
+void print_park_facturation(park_t* park, int by_day,
+                              timestamp_t date, system_t* sys);
+
+long long to_cents(float value);
+
+void index_revenue(park_t* park, timestamp_t exit_d,
+ long long cents, system_t* sys);
+
+void unindex_park_revenue(park_t* park, system_t* sys);
+
+void print_revenue(fenwick_t* revenue_idx,
+ timestamp_t from, timestamp_t to);
+
+/***************/
+/* occupancy.c */
+/***************/
+
+occupancy_series_t* init_series();
+
+void free_series(occupancy_series_t* series);
+
+int encode_varint(unsigned char* buf, unsigned value);
+
+int decode_varint(const unsigned char* buf, unsigned* value);
+
+unsigned zigzag(int value);
+
+int unzigzag(unsigned value);
+
+void series_append(occupancy_series_t* series, int time,
+ int occupancy);
+
+int series_find_block(occupancy_series_t* series, int time);
+
+int series_occupancy_at(occupancy_series_t* series, int time,
+ long long* area);
+
+int series_peak(occupancy_series_t* series, int from, int to);
+
+void print_occupancy_at(park_t* park, timestamp_t at);
+
+void print_occupancy_range(park_t* park, timestamp_t from,
+ timestamp_t to);
+
+/**************/
+/* rankings.c */
+/**************/
+
+leaderboard_t* init_leaderboard();
+
+int ranks_before(ranked_t* r1, ranked_t* r2);
+
+void leaderboard_update(leaderboard_t* board, vehicle_t* vhc,
+ long long score);
+
+vehicle_stats_t* get_vehicle_stats_if_any(vehicle_t* vhc, park_t* park);
+
+vehicle_stats_t* get_vehicle_stats(vehicle_t* vhc, park_t* park);
+
+void rank_exit(vehicle_t* vhc, park_t* park, long long cents,
+ system_t* sys);
+
+void unrank_park(park_t* park, system_t* sys);
+
+void free_vehicle_stats(vehicle_t* vhc);
+
+void print_leaderboards(leaderboard_t* top_paid,
+ leaderboard_t* top_visits, int count);
+
+/*************/
+/* history.c */
+/*************/
+
+history_t* init_history();
+
+void free_history(history_t* history);
+
+void shrink_history(history_t* history);
+
+void history_append(history_t* history, int entry_time, int exit_time,
+ int vehicle_id, long long cents);
+
+int history_age_out_entries(history_t* history, int before);
+
+void history_iter_init(history_iter_t* it, history_t* history, int from);
+
+int history_iter_next(history_iter_t* it, stay_t* stay, system_t* sys);
+
+void print_history_facturation_by_day(park_t* park,
+ timestamp_t facturation_date, system_t* sys);
+
+void print_history_facturation(park_t* park, system_t* sys);
+
+void print_daily_cents(int day, long long cents);
+
+int log_vehicle_history_in_park(vehicle_t* vhc, park_t* park,
+ system_t* sys);
+
+/***************/
+/* retention.c */
+/***************/
+
+void add_day_total(park_t* park, int day, long long cents);
+
+int day_aged_out(park_t* park, int day);
+
+long long print_day_totals(park_t* park, int until_day);
+
+int age_out_lists(park_t* park, int cutoff_day, int budget);
+
+int age_out_history(park_t* park, int cutoff_day, int budget,
+ system_t* sys);
+
+int retention_parks(system_t* sys, int first, int count, int budget);
+
+void retention_step(system_t* sys);
+
+void reclaim_cold_history(system_t* sys);
+
+int aged_out_stays(vehicle_t* vhc, park_t* park, int listed);
+
+/**************/
+/* snapshot.c */
+/**************/
+
+int is_query_command(char command);
+
+int fork_snapshot();
+
+void run_snapshot(char* path, char* line, system_t* sys, char* buffer);
+
+void reap_snapshots();
+
+void wait_snapshots();
+
+/************/
+/* ingest.c */
+/************/
+
+char* parse_line_name(char* s, char* name);
+
+int parse_movement_line(char* line, char* name, bulk_record_t* rec);
+
+int is_blank_line(char* line);
+
+void read_record(bulk_record_t* rec, char* line, int line_num, char* name);
+
+void bulk_precheck(bulk_chunk_t* chunk, system_t* sys);
+
+void bulk_resolve(bulk_chunk_t* chunk, system_t* sys);
+
+void bulk_apply(bulk_chunk_t* chunk, bulk_stats_t* stats, system_t* sys);
+
+void print_bulk_error(bulk_record_t* rec, int error, park_t* park);
+
+void bulk_load(char** paths, int num_paths, system_t* sys);
+
+void bulk_line(bulk_chunk_t* chunk, char* line, int line_num,
+                bulk_stats_t* stats, system_t* sys);
+
 /**************/
 /* vehicles.c */
 /**************/
@@ -125,10 +366,15 @@ void vehicle_activity_logs(char* license_plate, system_t* sys);
 int log_vehicle_activities_in_park(char* license_plate,
  park_t* park);
 
+int log_vehicle_activities_and_aged(vehicle_t* vhc, park_t* park,
+ system_t* sys);
+
 void print_corresponding_exit_if_exists(char* license_plate,
  entry_t* entry, park_t* park);
 
-void print_entries(entry_t* entry);
+void print_entries(entry_t* entry, park_t* park);
+
+void sort_by_park_rank(int* ids, int num_ids, system_t* sys);
 
 void print_corresponding_exits(exit_t* corresponding_exit);
 
@@ -138,7 +384,7 @@ void print_corresponding_exits(exit_t* corresponding_exit);
 
 list_t* init_list();
 
-void insert_list(list_t* list, void* elem);
+node_t* insert_list(list_t* list, void* elem);
 
 void sorted_insert_list(list_t* list, void* elem, char type);
 
@@ -153,14 +399,430 @@ void delete_list(list_t* list);
 
 void delete_node(list_t* list, void* val);
 
-int hash(char* plate);
+void unlink_node(list_t* list, node_t* node);
+
+skiplist_t* init_skiplist();
+
+int skiplist_random_level(skiplist_t* sl);
+
+void skiplist_find(skiplist_t* sl, const char* key,
+ skip_node_t* update[]);
+
+void skiplist_insert(skiplist_t* sl, char* key, void* val);
+
+void skiplist_delete(skiplist_t* sl, const char* key);
+
+skip_node_t* skiplist_lower_bound(skiplist_t* sl, const char* key);
+
+void delete_skiplist(skiplist_t* sl);
+
+fenwick_t* init_fenwick();
+
+void grow_fenwick(fenwick_t* ft);
+
+void fenwick_add(fenwick_t* ft, int idx, long long value);
+
+long long fenwick_prefix(fenwick_t* ft, int idx);
+
+long long fenwick_range(fenwick_t* ft, int lo, int hi);
+
+void free_fenwick(fenwick_t* ft);
+
+daily_t* init_daily(int bucket_bytes);
+
+void free_daily(daily_t* daily);
+
+void* daily_bucket(daily_t* daily, int day);
+
+unsigned int hash(char* plate);
 
 hash_table* init_ht();
 
+void grow_ht(hash_table* hashtable);
+
 void insert_ht(hash_table* hashtable, vehicle_t* vehicle);
 
+vehicle_t* search_chain(node_h* current, unsigned int h, char* plate);
+
 vehicle_t* search_ht(hash_table* hashtable, char* plate);
 
+void search_ht_batch(hash_table* hashtable, char** plates, int n,
+                      vehicle_t** found);
+
+/***********/
+/* cache.c */
+/***********/
+
+query_cache_t* init_query_cache();
+
+void drop_cached_query(query_cache_t* cache, cached_query_t* cached);
+
+void clear_query_cache(query_cache_t* cache);
+
+void free_query_cache(query_cache_t* cache);
+
+void invalidate_query_cache(query_cache_t* cache);
+
+cached_query_t* find_cached_query(query_cache_t* cache, char* key,
+                                    unsigned int h);
+
+int serve_cached_query(query_cache_t* cache, char* key,
+                         unsigned int version);
+
+void begin_query_capture(query_cache_t* cache);
+
+void end_query_capture(query_cache_t* cache, char* key,
+                         unsigned int version);
+
+void print_cache_stats(query_cache_t* cache);
+
+/**************/
+/* visitors.c */
+/**************/
+
+hll_t* init_hll();
+
+unsigned long long hll_hash(char* plate);
+
+void hll_add(hll_t* hll, char* plate);
+
+void hll_merge(hll_t* into, hll_t* from);
+
+double natural_log(double x);
+
+long long hll_estimate(hll_t* hll);
+
+void print_hll(hll_t* hll);
+
+int read_hll(hll_t* hll, char* line);
+
+void count_visitor(daily_t* visitors, int day, char* plate);
+
+void merge_visitors(hll_t* into, daily_t* visitors,
+                      int from_day, int to_day);
+
+void print_distinct_vehicles(park_t* park, timestamp_t from,
+                               timestamp_t to, system_t* sys);
+
+/************/
+/* export.c */
+/************/
+
+void write_le(FILE* out, unsigned long long value, int width);
+
+long long plate_key(char* plate);
+
+void flush_export_chunk(export_chunk_t* chunk);
+
+void export_row(export_chunk_t* chunk, vehicle_t* vhc, int entry_time,
+                  int exit_time, long long cents, int park_id);
+
+void export_park(export_chunk_t* chunk, park_t* park, int from, int to,
+                   system_t* sys);
+
+void export_stays(FILE* out, park_t* park, int from, int to,
+                    system_t* sys);
+
+void run_export(char* path, park_t* park, int from, system_t* sys);
+
+/***********/
+/* stays.c */
+/***********/
+
+stay_index_t* init_stay_index();
+
+void free_stay_index(stay_index_t* index);
+
+void rebuild_stay_tree(stay_index_t* index);
+
+void grow_stay_index(stay_index_t* index);
+
+void index_stay(stay_index_t* index, int entry_time, int exit_time,
+                  int vehicle_id);
+
+int first_stay_after(stay_index_t* index, int minute);
+
+void age_out_stays(stay_index_t* index, int cutoff);
+
+void add_present(present_t** present, int* count, int* capacity,
+                   vehicle_t* vhc, int entry_time, int exit_time);
+
+void collect_stays(stay_index_t* index, int node, int lo, int hi,
+                     int from, int until, present_t** present, int* count,
+                     int* capacity, system_t* sys);
+
+int compare_present(const void* a, const void* b);
+
+void print_present(park_t* park, int from, int to, system_t* sys);
+
+/************/
+/* alerts.c */
+/************/
+
+timing_wheel_t* init_alerts();
+
+void place_alert(timing_wheel_t* wheel, alert_t* alert);
+
+void unplace_alert(timing_wheel_t* wheel, alert_t* alert);
+
+void cascade_slot(timing_wheel_t* wheel, list_t* slot);
+
+void advance_alerts(timing_wheel_t* wheel, int minute);
+
+void arm_alert(timing_wheel_t* wheel, vehicle_t* vhc, park_t* park,
+                 int entry_time);
+
+void cancel_alert(timing_wheel_t* wheel, vehicle_t* vhc);
+
+void clear_alerts(timing_wheel_t* wheel);
+
+void free_alerts(timing_wheel_t* wheel);
+
+void set_alert_threshold(int hours, system_t* sys);
+
+int compare_alerts(const void* a, const void* b);
+
+void print_alerts(timing_wheel_t* wheel);
+
+/***************/
+/* durations.c */
+/***************/
+
+duration_histogram_t* init_histogram();
+
+int duration_bucket(int minutes);
+
+int bucket_highest(int bucket);
+
+void histogram_merge(duration_histogram_t* into,
+                       duration_histogram_t* from);
+
+long long histogram_total(duration_histogram_t* histogram);
+
+int histogram_percentile(duration_histogram_t* histogram, int percent);
+
+void print_histogram(duration_histogram_t* histogram);
+
+int read_histogram(duration_histogram_t* histogram, char* line);
+
+void count_duration(daily_t* durations, int day, int minutes);
+
+void merge_durations(duration_histogram_t* into, daily_t* durations,
+                       int from_day, int to_day);
+
+void print_percentiles(duration_histogram_t* histogram);
+
+void print_stay_durations(park_t* park, timestamp_t from,
+                            timestamp_t to, system_t* sys);
+
+/***********/
+/* gates.c */
+/***********/
+
+void lock_system(system_t* sys);
+
+void unlock_system(system_t* sys);
+
+int sequence_movement(gate_ingest_t* ingest, int minute);
+
+int gate_movement(gate_ingest_t* ingest, bulk_record_t* rec, park_t* park);
+
+void gate_apply(gate_feed_t* feed, bulk_record_t* rec);
+
+void* gate_feed_loop(void* arg);
+
+void print_gate_feed(gate_feed_t* feed, system_t* sys);
+
+void gate_ingest(char** paths, int num_feeds, system_t* sys);
+
+/************/
+/* report.c */
+/************/
+
+void add_fare(park_report_t* report, int day, long long cents);
+
+long long sum_fares(long long* fares, int count);
+
+void build_park_report(park_report_t* report, system_t* sys);
+
+void* report_loop(void* arg);
+
+void print_revenue_report(system_t* sys);
+
+/************/
+/* events.c */
+/************/
+
+event_stream_t* init_events();
+
+void publish_occupancy(event_stream_t* events, park_t* park);
+
+int write_pending(subscriber_t* sub);
+
+void write_occupancy(subscriber_t* sub, park_t* park, int free);
+
+void mark_changed(subscriber_t* sub, int park_id);
+
+void deliver_occupancy(subscriber_t* sub, int park_id, int free,
+                         system_t* sys);
+
+void catch_up(subscriber_t* sub, system_t* sys);
+
+void drop_subscriber(event_stream_t* events, int i);
+
+void pump_events(system_t* sys);
+
+int open_subscriber(char* path);
+
+void subscribe(char* path, park_t* park, system_t* sys);
+
+int count_subscribers(event_stream_t* events, int park_id);
+
+void forget_park_events(event_stream_t* events, int park_id);
+
+void free_events(system_t* sys);
+
+/**************/
+/* protocol.c */
+/**************/
+
+long long read_le(unsigned char* bytes, int width);
+
+void binary_movement(unsigned char* request, binary_reply_t* reply,
+                       system_t* sys);
+
+void write_reply(unsigned char* request, binary_reply_t* reply);
+
+void run_binary(system_t* sys, char* buffer);
+
+/***********/
+/* merge.c */
+/***********/
+
+int merge_read(merge_feed_t* feed, merge_t* merge);
+
+int merge_before(merge_t* merge, int a, int b);
+
+void merge_sift_down(merge_t* merge, int pos);
+
+merge_t* merge_open(char** paths, int num_paths);
+
+merge_feed_t* merge_next(merge_t* merge);
+
+void merge_close(merge_t* merge);
+
+/************/
+/* router.c */
+/************/
+
+int jump_hash(unsigned long long key, int num_buckets);
+
+int park_shard(router_t* router, char* park_name);
+
+router_t* init_router(system_t* sys, char* buffer);
+
+void close_router(router_t* router);
+
+void run_router(system_t* sys, char* buffer);
+
+void shard_send(router_t* router, int s, char* request, int elsewhere);
+
+void shard_receive(router_t* router, int s);
+
+void route_to(router_t* router, int s, char* request, int elsewhere);
+
+void route_all(router_t* router, char* request);
+
+int route_retention_parks(router_t* router, int from, int to, int budget);
+
+void route_retention_step(router_t* router);
+
+int name_shard(router_t* router, char* args, char* name);
+
+int find_router_park(router_t* router, char* name);
+
+int line_park(router_t* router, char* line);
+
+int vehicle_elsewhere(router_t* router, char* plate, int s);
+
+void track_vehicle(router_t* router, char* plate, int serial);
+
+void add_router_park(router_t* router, char* name, int s);
+
+void remove_router_park(router_t* router, int i);
+
+int same_answers(router_t* router);
+
+char* next_answer_line(char* answer, int* cursor, char* line);
+
+void print_by_creation(router_t* router, char* line);
+
+int compare_router_parks(const void* p1, const void* p2);
+
+void sort_router_parks(router_t* router, int* order);
+
+void print_by_name(router_t* router, char* line);
+
+void print_sum(router_t* router);
+
+void print_merged_sketches(router_t* router);
+
+void print_merged_report(router_t* router, char* line);
+
+int alert_line_key(char* line, int* minute, char* plate);
+
+void print_by_entry(router_t* router, char* line);
+
+void print_merged_histograms(router_t* router);
+
+void print_memory_sum(router_t* router, char* line);
+
+void print_router_leaderboards(router_t* router, int count, char* line);
+
+int has_args(char* args);
+
+void route_park_command(router_t* router, char* command, char* name);
+
+void route_sketch_query(router_t* router, char* command, char* name);
+
+void route_export(router_t* router, char* command, char* name);
+
+void route_create_park(router_t* router, char* command, char* name);
+
+void route_movement(router_t* router, char* command, char* name);
+
+void route_remove_park(router_t* router, char* command, char* name);
+
+void route_leaderboards(router_t* router, char* command, char* name);
+
+void route_feed_line(router_t* router, bulk_record_t* rec, char* line,
+                      bulk_stats_t* stats);
+
+void route_feed(router_t* router, FILE* file, bulk_stats_t* stats,
+                 char* name);
+
+void route_bulk_load(router_t* router, char* command, char* name);
+
+void route_gate_feeds(router_t* router, char* command, char* name);
+
+void route_retention(router_t* router, char* command);
+
+int router_subscribers(router_t* router);
+
+void route_subscribe(router_t* router, char* command, char* name);
+
+void route_snapshot(router_t* router, char* command, char* name);
+
+int route_line(router_t* router, char* line, char* name);
+
+void apply_context(char* context, system_t* sys);
+
+void print_vehicle_totals(system_t* sys);
+
+void run_request(char* request, system_t* sys, char* buffer);
+
+void worker_loop(system_t* sys, char* buffer);
+
 /***********/
 /* dates.c */
 /***********/
@@ -169,6 +831,12 @@ int get_time_in_mins(timestamp_t ts);
 
 int get_month_mins(int month, int year);
 
+int get_day_index(timestamp_t ts);
+
+int get_minute_index(timestamp_t ts);
+
+timestamp_t minute_to_timestamp(int minute);
+
 int compare_date_time(timestamp_t d1, timestamp_t d2);
 
 int compare_date(timestamp_t d1, timestamp_t d2);
@@ -0,0 +1,53 @@
+# Shows the stays of a file written by the 'x' command as text.
+#
+#   python3 export.py test31.second.exp
+#
+# Prints the watermarks of the file, then for each chunk its number of
+# rows, the smallest and largest value of each column and the rows,
+# and at last the total number of rows the file ends with.
+import struct
+import sys
+
+COLUMNS = ["plate", "entry", "exit", "cents", "park"]
+
+
+def show(value, column):
+    if column == "plate":
+        return value.to_bytes(8, "big").rstrip(b"\0").decode()
+    return str(value)
+
+
+def decode(data, out):
+    magic, version, columns, start, end = struct.unpack_from("<4siiii", data)
+    out.write("%s %d %d from %d to %d\n" % (magic.decode(), version,
+                                            columns, start, end))
+    pos = 20
+    while True:
+        (rows,) = struct.unpack_from("<i", data, pos)
+        pos += 4
+        if not rows:
+            break
+        out.write("chunk %d\n" % rows)
+        values = []
+        for _ in range(columns):
+            column, width = data[pos], data[pos + 1]
+            low, high = struct.unpack_from("<qq", data, pos + 2)
+            pos += 18
+            name = COLUMNS[column]
+            out.write("%s %s %s\n" % (name, show(low, name), show(high, name)))
+            values.append([show(int.from_bytes(data[pos + i * width:
+                                                    pos + (i + 1) * width],
+                                               "little", signed=True), name)
+                           for i in range(rows)])
+            pos += rows * width
+        for row in zip(*values):
+            out.write(" ".join(row) + "\n")
+    (total,) = struct.unpack_from("<q", data, pos)
+    out.write("total %d\n" % total)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("usage: export.py <file>")
+    with open(sys.argv[1], "rb") as f:
+        decode(f.read(), sys.stdout)
@@ -0,0 +1,51 @@
+# Replays gate controller traces in the binary protocol of the -b option.
+#
+#   python3 replay.py encode < test42.txt > test42.in
+#   ../project -b < test42.in | python3 replay.py decode
+#
+# A trace has one request per line, 'entry' or 'exit' followed by the
+# park id, the license plate and the minute since 01-01-2024 00:00.
+# Any other line is a text command and is sent as it is.
+# Decoding shows each 16 byte reply as the opcode, the status, the
+# park id, the minute of the entry and the value, and the text as it is.
+import struct
+import sys
+
+OPCODES = {"entry": 1, "exit": 2}
+NAMES = {code: name for name, code in OPCODES.items()}
+REQUEST = "<BBH8si"
+REPLY = "<BBHiq"
+
+
+def encode(trace, out):
+    for line in trace:
+        fields = line.split()
+        if fields and fields[0] in OPCODES:
+            park, plate, minute = int(fields[1]), fields[2], int(fields[3])
+            out.write(struct.pack(REQUEST, OPCODES[fields[0]], 0, park,
+                                  plate.encode(), minute))
+        else:
+            out.write(line.encode())
+
+
+def decode(replies, out):
+    while True:
+        opcode = replies.read(1)
+        if not opcode:
+            break
+        if opcode[0] not in NAMES:
+            out.write((opcode + replies.readline()).decode())
+            continue
+        record = opcode + replies.read(struct.calcsize(REPLY) - 1)
+        _, status, park, entry, value = struct.unpack(REPLY, record)
+        out.write("%s %d %d %d %d\n" % (NAMES[opcode[0]], status, park,
+                                         entry, value))
+
+
+if __name__ == "__main__":
+    if sys.argv[1:] == ["encode"]:
+        encode(sys.stdin, sys.stdout.buffer)
+    elif sys.argv[1:] == ["decode"]:
+        decode(sys.stdin.buffer, sys.stdout)
+    else:
+        sys.exit("usage: replay.py encode|decode")
@@ -0,0 +1,183 @@
+/**
+ * @file rankings.c
+ * 
+ * @author Tiago Firmino - ist1103590
+ * 
+ * File containing functions used to keep the leaderboards
+ * of the vehicles that paid the most and that made the
+ * most visits, for the whole system and for each park.
+ * 
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/**
+ * Creates a new empty leaderboard.
+*/
+leaderboard_t* init_leaderboard() {
+    leaderboard_t* board = (leaderboard_t*)safe_malloc(sizeof(leaderboard_t));
+    board->size = 0;
+    return board;
+}
+
+/**
+ * Checks whether the first ranking goes before the second one,
+ * by higher score and then by license plate.
+*/
+int ranks_before(ranked_t* r1, ranked_t* r2) {
+    if (r1->score != r2->score)
+        return r1->score > r2->score;
+    return strcmp(r1->vehicle->license_plate,
+     r2->vehicle->license_plate) < 0;
+}
+
+/**
+ * Updates the score of a vehicle in the leaderboard.
+ * Scores only ever grow, so a vehicle that is not ranked
+ * can only enter by taking the place of the last one,
+ * and a ranked vehicle can only move up.
+*/
+void leaderboard_update(leaderboard_t* board, vehicle_t* vhc,
+                          long long score) {
+    ranked_t ranked = {vhc, score};
+    int pos;
+
+    for (pos = 0; pos < board->size; pos++) {
+        if (board->ranks[pos].vehicle == vhc) break;
+    }
+    if (pos == board->size) {
+        if (board->size < TOPK_MAX) {
+            board->size++;
+        } else if (ranks_before(&ranked, &board->ranks[pos - 1])) {
+            pos--;
+        } else {
+            return;
+        }
+    }
+    while (pos > 0 && ranks_before(&ranked, &board->ranks[pos - 1])) {
+        board->ranks[pos] = board->ranks[pos - 1];
+        pos--;
+    }
+    board->ranks[pos] = ranked;
+}
+
+/**
+ * Returns the statistics a vehicle has in the given park,
+ * or NULL if the vehicle never left that park.
+*/
+vehicle_stats_t* get_vehicle_stats_if_any(vehicle_t* vhc, park_t* park) {
+    vehicle_stats_t* stats = vhc->park_stats;
+    while (stats && stats->park != park) {
+        stats = stats->next;
+    }
+    return stats;
+}
+
+/**
+ * Returns the statistics a vehicle has in the given park,
+ * creating them if the vehicle never left that park before.
+*/
+vehicle_stats_t* get_vehicle_stats(vehicle_t* vhc, park_t* park) {
+    vehicle_stats_t* stats = get_vehicle_stats_if_any(vhc, park);
+    if (!stats) {
+        int scope = mem_scope(MEM_VEHICLES);
+        stats = (vehicle_stats_t*)safe_malloc(sizeof(vehicle_stats_t));
+        mem_scope(scope);
+        stats->park = park;
+        stats->cents = 0;
+        stats->visits = 0;
+        stats->next = vhc->park_stats;
+        vhc->park_stats = stats;
+    }
+    return stats;
+}
+
+/**
+ * Accounts for a finished stay of a vehicle in a park,
+ * updating its totals and every leaderboard it belongs to.
+*/
+void rank_exit(vehicle_t* vhc, park_t* park, long long cents,
+                 system_t* sys) {
+    vehicle_stats_t* stats = get_vehicle_stats(vhc, park);
+    stats->cents += cents;
+    stats->visits++;
+    vhc->total_cents += cents;
+    vhc->total_visits++;
+
+    leaderboard_update(park->top_paid, vhc, stats->cents);
+    leaderboard_update(park->top_visits, vhc, stats->visits);
+    lock_system(sys);
+    leaderboard_update(sys->top_paid, vhc, vhc->total_cents);
+    leaderboard_update(sys->top_visits, vhc, vhc->total_visits);
+    unlock_system(sys);
+}
+
+/**
+ * Drops the statistics every vehicle has in a park that
+ * is being removed and rebuilds the system leaderboards,
+ * since the totals of those vehicles went down.
+*/
+void unrank_park(park_t* park, system_t* sys) {
+    sys->top_paid->size = 0;
+    sys->top_visits->size = 0;
+
+    for (int i = 0; i < sys->vhc_ht->size; i++) {
+        node_h* current = sys->vhc_ht->table[i];
+        for (; current != NULL; current = current->next) {
+            vehicle_t* vhc = current->vehicle;
+            vehicle_stats_t** link = &vhc->park_stats;
+            while (*link && (*link)->park != park) {
+                link = &(*link)->next;
+            }
+            if (*link) {
+                vehicle_stats_t* stats = *link;
+                vhc->total_cents -= stats->cents;
+                vhc->total_visits -= stats->visits;
+                *link = stats->next;
+                safe_free(stats);
+            }
+            if (vhc->total_visits > 0) {
+                leaderboard_update(sys->top_paid, vhc, vhc->total_cents);
+                leaderboard_update(sys->top_visits, vhc,
+                 vhc->total_visits);
+            }
+        }
+    }
+}
+
+/**
+ * Frees the park statistics of a vehicle.
+*/
+void free_vehicle_stats(vehicle_t* vhc) {
+    vehicle_stats_t* stats = vhc->park_stats;
+    while (stats) {
+        vehicle_stats_t* next = stats->next;
+        safe_free(stats);
+        stats = next;
+    }
+    vhc->park_stats = NULL;
+}
+
+/**
+ * Shows the first count vehicles by value paid
+ * followed by the first count vehicles by number of visits.
+*/
+void print_leaderboards(leaderboard_t* top_paid,
+                          leaderboard_t* top_visits, int count) {
+    int i;
+    for (i = 0; i < count && i < top_paid->size; i++) {
+        long long cents = top_paid->ranks[i].score;
+        printf("%s %lld.%02lld\n",
+         top_paid->ranks[i].vehicle->license_plate,
+         cents / 100, cents % 100);
+    }
+    for (i = 0; i < count && i < top_visits->size; i++) {
+        printf("%s %lld\n", top_visits->ranks[i].vehicle->license_plate,
+         top_visits->ranks[i].score);
+    }
+}
@@ -0,0 +1,152 @@
+/**
+ * @file report.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the nightly revenue report of every park, the
+ * daily facturation of each park and the total of all of them.
+ * The parks are independent, so a few threads take them one at a
+ * time and add up their exits at once, and the report is printed
+ * in name order once they are done. The fares of a park are first
+ * copied out of its exits into an array, so those of each day are
+ * added up in a plain loop the compiler vectorizes.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/**
+ * Adds a fare, in cents, and the day it was paid on to the fares
+ * of a park, making room for it if needed.
+*/
+void add_fare(park_report_t* report, int day, long long cents) {
+    if (report->num_fares == report->capacity) {
+        report->capacity = report->capacity ?
+         2 * report->capacity : REPORT_INIT_FARES;
+        report->days = (int*)safe_realloc(report->days,
+         report->capacity * sizeof(int));
+        report->fares = (long long*)safe_realloc(report->fares,
+         report->capacity * sizeof(long long));
+    }
+    report->days[report->num_fares] = day;
+    report->fares[report->num_fares++] = cents;
+}
+
+/**
+ * Returns the sum of an array of fares.
+*/
+long long sum_fares(long long* fares, int count) {
+    long long sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += fares[i];
+    }
+    return sum;
+}
+
+/**
+ * Adds up the fares of a park by day, in exit order, starting
+ * with the daily totals that were aged out. Each day replaces
+ * its first fare, so the report keeps a day and a total per day.
+*/
+void build_park_report(park_report_t* report, system_t* sys) {
+    park_t* park = report->park;
+    node_t* current = park->day_totals->head;
+
+    for (; current != NULL; current = current->next) {
+        day_total_t* total = (day_total_t*)current->val;
+        add_fare(report, total->day, total->cents);
+    }
+    if (park->history) {
+        history_iter_t it;
+        stay_t stay;
+        history_iter_init(&it, park->history, 0);
+        while (history_iter_next(&it, &stay, sys)) {
+            add_fare(report, stay.exit_time / MINS_IN_DAY, stay.cents);
+        }
+    } else {
+        for (current = park->park_exits->head; current != NULL;
+            current = current->next) {
+            exit_t* exit = (exit_t*)current->val;
+            add_fare(report, get_day_index(exit->exit_date_time),
+             to_cents(exit->paid_value));
+        }
+    }
+
+    int num_days = 0;
+    report->total = 0;
+    for (int i = 0, j; i < report->num_fares; i = j) {
+        for (j = i + 1; j < report->num_fares &&
+            report->days[j] == report->days[i]; j++);
+        report->days[num_days] = report->days[i];
+        report->fares[num_days] = sum_fares(report->fares + i, j - i);
+        report->total += report->fares[num_days++];
+    }
+    report->num_fares = num_days;
+}
+
+/**
+ * Main loop of a thread of the report, taking the next park
+ * that no thread took yet until there are none left.
+*/
+void* report_loop(void* arg) {
+    revenue_report_t* report = (revenue_report_t*)arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&report->next, 1, __ATOMIC_RELAXED)) <
+        report->num_parks) {
+        build_park_report(&report->parks[i], report->sys);
+    }
+    return NULL;
+}
+
+/**
+ * Shows the daily facturation of every park, in name order,
+ * each after its name and total, and then the total of every park.
+*/
+void print_revenue_report(system_t* sys) {
+    revenue_report_t report;
+    pthread_t threads[REPORT_THREADS];
+    int num_threads = 0;
+    long long total = 0;
+
+    report.sys = sys;
+    report.next = 0;
+    report.num_parks = 0;
+    report.parks = (park_report_t*)safe_malloc(
+     (sys->num_parks ? sys->num_parks : 1) * sizeof(park_report_t));
+    skip_node_t* current = skiplist_lower_bound(sys->srtd_parks, NULL);
+    for (; current != NULL; current = current->next[0]) {
+        park_report_t* park_report = &report.parks[report.num_parks++];
+        memset(park_report, 0, sizeof(park_report_t));
+        park_report->park = (park_t*)current->val;
+    }
+
+    // The calling thread takes parks too, alone if no thread starts
+    while (num_threads < REPORT_THREADS - 1 &&
+        num_threads < report.num_parks - 1 &&
+        !pthread_create(&threads[num_threads], NULL, report_loop, &report))
+        num_threads++;
+    report_loop(&report);
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < report.num_parks; i++) {
+        park_report_t* park_report = &report.parks[i];
+        printf("%s %lld.%02lld\n", park_report->park->park_name,
+         park_report->total / 100, park_report->total % 100);
+        for (int k = 0; k < park_report->num_fares; k++) {
+            print_daily_cents(park_report->days[k], park_report->fares[k]);
+        }
+        total += park_report->total;
+        safe_free(park_report->days);
+        safe_free(park_report->fares);
+    }
+    printf("%lld.%02lld\n", total / 100, total % 100);
+    safe_free(report.parks);
+}
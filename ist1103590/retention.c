@@ -0,0 +1,228 @@
+/**
+ * @file retention.c
+ * 
+ * @author Tiago Firmino - ist1103590
+ * 
+ * File containing functions used to age out old movements.
+ * Once a retention period is set, entries and exits older than
+ * that period are released a few at a time after each movement,
+ * leaving behind the daily totals of each park. Per vehicle
+ * totals are already kept by the rankings.
+ * 
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+
+/**
+ * Adds the value of an aged out exit to the daily totals
+ * of the park. Exits are aged out in order, so the day is
+ * either the last one of the list or a new one.
+*/
+void add_day_total(park_t* park, int day, long long cents) {
+    day_total_t* total = park->day_totals->tail ?
+     (day_total_t*)park->day_totals->tail->val : NULL;
+
+    if (!total || total->day != day) {
+        int scope = mem_scope(MEM_HISTORY);
+        total = (day_total_t*)safe_malloc(sizeof(day_total_t));
+        total->day = day;
+        total->cents = 0;
+        insert_list(park->day_totals, total);
+        mem_scope(scope);
+    }
+    total->cents += cents;
+}
+
+/**
+ * Checks whether any movement of the given day was aged out.
+*/
+int day_aged_out(park_t* park, int day) {
+    node_t* last = park->day_totals->tail;
+    return last && ((day_total_t*)last->val)->day >= day;
+}
+
+/**
+ * Prints the aged out daily totals before the given day and
+ * returns the aged out total of that day itself, which the caller
+ * must add to its detailed movements of the same day.
+*/
+long long print_day_totals(park_t* park, int until_day) {
+    node_t* current = park->day_totals->head;
+    while (current) {
+        day_total_t* total = (day_total_t*)current->val;
+        if (total->day == until_day) return total->cents;
+        if (total->day > until_day) break;
+        print_daily_cents(total->day, total->cents);
+        current = current->next;
+    }
+    return 0;
+}
+
+/**
+ * Releases up to budget entries and then exits of a park with
+ * entry and exit lists, older than the cutoff day.
+ * Entries go first so that a listed entry never loses its exit.
+ * Current entries are moved to the park's open entries instead,
+ * since vehicles still point to them, so that later steps never
+ * walk past them again; their exits bring them back.
+ * Returns the budget left.
+*/
+int age_out_lists(park_t* park, int cutoff_day, int budget) {
+    while (park->park_entries->head && budget > 0) {
+        node_t* current = park->park_entries->head;
+        entry_t* entry = (entry_t*)current->val;
+        if (get_day_index(entry->entry_date_time) >= cutoff_day)
+            break;
+        if (entry->vehicle->current_entry == entry) {
+            int scope = mem_scope(MEM_ENTRIES);
+            entry->open_node = insert_list(park->open_entries, entry);
+            mem_scope(scope);
+        } else
+            safe_free(entry);
+        unlink_node(park->park_entries, current);
+        budget--;
+    }
+
+    while (park->park_exits->head && budget > 0) {
+        exit_t* exit = (exit_t*)park->park_exits->head->val;
+        int day = get_day_index(exit->exit_date_time);
+        if (day >= cutoff_day) break;
+        add_day_total(park, day, to_cents(exit->paid_value));
+        unlink_node(park->park_exits, park->park_exits->head);
+        safe_free(exit);
+        budget--;
+    }
+    return budget;
+}
+
+/**
+ * Releases up to budget of the oldest stays of a park with compact
+ * history that ended before the cutoff day, one stay per unit of
+ * budget, along with the blocks they leave empty. As with the lists,
+ * the stays that entered before that day are no longer listed once
+ * the park is reached, even if they ended later, and the cached
+ * results that listed them are dropped.
+ * Returns the budget left.
+*/
+int age_out_history(park_t* park, int cutoff_day, int budget,
+                      system_t* sys) {
+    history_t* history = park->history;
+    unsigned exit_delta, length, vehicle_id, cents;
+
+    if (budget > 0 &&
+        history_age_out_entries(history, cutoff_day * MINS_IN_DAY))
+        invalidate_query_cache(sys->cache);
+    while (history->num_blocks && budget > 0) {
+        history_block_t* block = history->blocks;
+        int pos = 0, time = block->base_exit;
+
+        while (pos < block->used && budget > 0) {
+            int next = pos + decode_varint(block->data + pos, &exit_delta);
+            if ((time + (int)exit_delta) / MINS_IN_DAY >= cutoff_day) break;
+            next += decode_varint(block->data + next, &length);
+            next += decode_varint(block->data + next, &vehicle_id);
+            next += decode_varint(block->data + next, &cents);
+            time += exit_delta;
+            add_day_total(park, time / MINS_IN_DAY, cents);
+            block->count--;
+            history->first_stay++;
+            budget--;
+            pos = next;
+        }
+        // The rest of the block now counts from the last exit dropped
+        if (pos < block->used) {
+            block->used -= pos;
+            memmove(block->data, block->data + pos, block->used);
+            block->base_exit = time;
+            break;
+        }
+        history->num_blocks--;
+        memmove(history->blocks, history->blocks + 1,
+         history->num_blocks * sizeof(history_block_t));
+    }
+    return budget;
+}
+
+/**
+ * Ages out old movements of count parks, in order of creation from
+ * the given position, until the budget runs out.
+ * Cached query results may show what was aged out, so they are
+ * dropped if anything was. Returns the budget left.
+*/
+int retention_parks(system_t* sys, int first, int count, int budget) {
+    int start = budget;
+    int cutoff_day = get_day_index(sys->date_registry) - sys->retention_days;
+    node_t* current = sys->parks->head;
+
+    for (; current && first > 0; first--) current = current->next;
+    for (; current && count > 0 && budget > 0; count--) {
+        park_t* park = (park_t*)current->val;
+        age_out_stays(park->stays, cutoff_day * MINS_IN_DAY);
+        if (park->history)
+            budget = age_out_history(park, cutoff_day, budget, sys);
+        else
+            budget = age_out_lists(park, cutoff_day, budget);
+        current = current->next;
+    }
+    if (budget < start)
+        invalidate_query_cache(sys->cache);
+    return budget;
+}
+
+/**
+ * Ages out a bounded number of old movements of the parks,
+ * so that a single command never pauses for long.
+ * Each step starts one park further than the last, wrapping
+ * around, so no park waits behind the ones before it.
+ * Called after every movement. In router mode the router takes
+ * the step instead, through the workers, so the budget is shared
+ * by the parks of every worker as in a single process.
+*/
+void retention_step(system_t* sys) {
+    int first, budget;
+
+    if (!sys->retention_days || sys->num_shards || !sys->num_parks) return;
+    first = sys->retention_next % sys->num_parks;
+    budget = retention_parks(sys, first, sys->num_parks - first,
+     RETENTION_STEP);
+    retention_parks(sys, 0, first, budget);
+    sys->retention_next = first + 1;
+}
+
+/**
+ * Ages out every movement before the current day, regardless of
+ * the retention period, and gives back the blocks the compact
+ * histories no longer need, along with the cached query results.
+ * Used to make room when the memory budget runs out.
+*/
+void reclaim_cold_history(system_t* sys) {
+    int cutoff_day = get_day_index(sys->date_registry);
+    node_t* current = sys->parks->head;
+    clear_query_cache(sys->cache);
+    for (; current != NULL; current = current->next) {
+        park_t* park = (park_t*)current->val;
+        age_out_stays(park->stays, cutoff_day * MINS_IN_DAY);
+        if (park->history) {
+            age_out_history(park, cutoff_day, INT_MAX, sys);
+            shrink_history(park->history);
+        } else {
+            age_out_lists(park, cutoff_day, INT_MAX);
+        }
+    }
+}
+
+/**
+ * Returns the number of stays a vehicle made in a park
+ * that can no longer be listed, given the number of
+ * completed stays that were listed.
+*/
+int aged_out_stays(vehicle_t* vhc, park_t* park, int listed) {
+    vehicle_stats_t* stats = get_vehicle_stats_if_any(vhc, park);
+    return stats ? stats->visits - listed : 0;
+}
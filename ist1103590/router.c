@@ -0,0 +1,1236 @@
+/**
+ * @file router.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the router mode, where the parks are split among
+ * worker processes by a consistent hash of their name. The router
+ * reads the commands and sends each one to the worker that owns its
+ * park, or to every worker when it spans all parks, merging their
+ * answers so the output is the same a single process would give.
+ * Each worker is told, before every request, the system wide state
+ * it cannot see (the date of the last movement, the number of parks
+ * and whether the vehicle of an entry is in a park of another
+ * worker), and reports its own state back after answering.
+ * Commands are expected one per line.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/**
+ * Maps a key to one of num_buckets buckets (jump consistent hash),
+ * so that adding a worker only moves about 1/n of the parks.
+*/
+int jump_hash(unsigned long long key, int num_buckets) {
+    long long b = -1, j = 0;
+    while (j < num_buckets) {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (long long)((b + 1) *
+         ((double)(1LL << 31) / (double)((key >> 33) + 1)));
+    }
+    return (int)b;
+}
+
+/**
+ * Returns the worker that owns the park with the given name.
+*/
+int park_shard(router_t* router, char* park_name) {
+    return jump_hash(hash(park_name), router->num_shards);
+}
+
+/**
+ * Starts the worker processes, each one reading its requests
+ * from a pipe and writing its answers to another one.
+*/
+router_t* init_router(system_t* sys, char* buffer) {
+    router_t* router = (router_t*)safe_malloc(sizeof(router_t));
+    router->num_shards = sys->num_shards;
+    router->num_parks = 0;
+    router->next_serial = 0;
+    router->retention_days = 0;
+    router->retention_next = 0;
+    router->date_registry = sys->date_registry;
+    router->vehicles = init_ht();
+
+    fflush(stdout);
+    for (int i = 0; i < router->num_shards; i++) {
+        shard_t* shard = &router->shards[i];
+        int requests[2], answers[2], pid = -1;
+
+        if (pipe(requests) == 0 && pipe(answers) == 0) pid = fork();
+        if (pid < 0) {
+            printf(ROUTER_FAILED);
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            for (int j = 0; j < i; j++) {
+                fclose(router->shards[j].requests);
+                fclose(router->shards[j].answers);
+                safe_free(router->shards[j].answer);
+            }
+            dup2(requests[0], STDIN_FILENO);
+            dup2(answers[1], STDOUT_FILENO);
+            close(requests[0]);
+            close(requests[1]);
+            close(answers[0]);
+            close(answers[1]);
+            free_hashtable(router->vehicles);
+            safe_free(router);
+            worker_loop(sys, buffer);
+            free_mem(sys, buffer);
+            exit(EXIT_SUCCESS);
+        }
+        close(requests[0]);
+        close(answers[1]);
+        shard->pid = pid;
+        shard->requests = fdopen(requests[1], "w");
+        shard->answers = fdopen(answers[0], "r");
+        shard->answer = (char*)safe_malloc(MAX_LINE_SIZE);
+        shard->answer[0] = '\0';
+        shard->answer_len = 0;
+        shard->answer_capacity = MAX_LINE_SIZE;
+        shard->num_parks = 0;
+        shard->num_movements = 0;
+        shard->all_subscribers = 0;
+        shard->park_subscribers = 0;
+    }
+    return router;
+}
+
+/**
+ * Stops the workers, waiting for them to finish,
+ * and frees the router.
+*/
+void close_router(router_t* router) {
+    for (int i = 0; i < router->num_shards; i++) {
+        fclose(router->shards[i].requests);
+    }
+    for (int i = 0; i < router->num_shards; i++) {
+        waitpid(router->shards[i].pid, NULL, 0);
+        fclose(router->shards[i].answers);
+        safe_free(router->shards[i].answer);
+    }
+    for (int i = 0; i < router->num_parks; i++) {
+        safe_free(router->park_names[i]);
+    }
+    free_hashtable(router->vehicles);
+    safe_free(router);
+}
+
+/**
+ * Runs the router mode until the quit command or the end of input.
+*/
+void run_router(system_t* sys, char* buffer) {
+    router_t* router = init_router(sys, buffer);
+    char* name = (char*)safe_malloc(MAX_LINE_SIZE);
+
+    while (fgets(buffer, MAX_LINE_SIZE, stdin) &&
+        route_line(router, buffer, name));
+    safe_free(name);
+    close_router(router);
+}
+
+/* Talking to the workers */
+
+/**
+ * Sends a request to a worker, preceded by the system wide
+ * state it needs to handle it.
+*/
+void shard_send(router_t* router, int s, char* request, int elsewhere) {
+    shard_t* shard = &router->shards[s];
+    timestamp_t date = router->date_registry;
+
+    fprintf(shard->requests, "%c%d %d %d %d %d %d %d\n", ROUTER_CONTEXT,
+     date.y, date.mth, date.d, date.h, date.min,
+     router->num_parks, elsewhere);
+    fputs(request, shard->requests);
+    if (request[strlen(request) - 1] != '\n')
+        fputc('\n', shard->requests);
+    fflush(shard->requests);
+}
+
+/**
+ * Reads the answer of a worker up to its status line, keeping
+ * the state it reports. If the worker died, so does the router,
+ * as a single process would have.
+*/
+void shard_receive(router_t* router, int s) {
+    shard_t* shard = &router->shards[s];
+    char line[MAX_LINE_SIZE];
+    int line_start = TRUE;
+
+    shard->answer_len = 0;
+    shard->answer[0] = '\0';
+    while (fgets(line, MAX_LINE_SIZE, shard->answers)) {
+        int len = strlen(line);
+        if (line_start && line[0] == ROUTER_STATUS) {
+            timestamp_t* date = &shard->date_registry;
+            sscanf(line + 1, "%d %d %d %d %d %d %lld %d %d", &date->y,
+             &date->mth, &date->d, &date->h, &date->min, &shard->num_parks,
+             &shard->num_movements, &shard->all_subscribers,
+             &shard->park_subscribers);
+            return;
+        }
+        if (shard->answer_len + len + 1 > shard->answer_capacity) {
+            shard->answer_capacity = 2 * (shard->answer_len + len + 1);
+            shard->answer = (char*)safe_realloc(shard->answer,
+             shard->answer_capacity);
+        }
+        memcpy(shard->answer + shard->answer_len, line, len + 1);
+        shard->answer_len += len;
+        line_start = line[len - 1] == '\n';
+    }
+    fputs(shard->answer, stdout);
+    fflush(stdout);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Sends a request to one worker and waits for its answer.
+ * The worker knew the latest date, so its date is the new one.
+*/
+void route_to(router_t* router, int s, char* request, int elsewhere) {
+    shard_send(router, s, request, elsewhere);
+    shard_receive(router, s);
+    router->date_registry = router->shards[s].date_registry;
+}
+
+/**
+ * Sends a request to every worker, so they all work on it
+ * at the same time, and then waits for all the answers.
+*/
+void route_all(router_t* router, char* request) {
+    for (int s = 0; s < router->num_shards; s++) {
+        shard_send(router, s, request, FALSE);
+    }
+    for (int s = 0; s < router->num_shards; s++) {
+        shard_receive(router, s);
+    }
+}
+
+/**
+ * Ages out old movements of the parks from position from up to
+ * (not including) position to, in order of creation, until the
+ * budget runs out. Each run of parks owned by the same worker is
+ * one request, and the budget the worker leaves goes on to the
+ * next one. Returns the budget left.
+*/
+int route_retention_parks(router_t* router, int from, int to, int budget) {
+    char request[MAX_LINE_SIZE];
+
+    for (int i = from; i < to && budget > 0;) {
+        int s = router->park_shards[i], first = 0, count = 0;
+        for (int k = 0; k < i; k++) {
+            first += router->park_shards[k] == s;
+        }
+        for (; i < to && router->park_shards[i] == s; i++) {
+            count++;
+        }
+        snprintf(request, sizeof(request), "%c%d %d %d", ROUTER_RETENTION,
+         first, count, budget);
+        route_to(router, s, request, FALSE);
+        sscanf(router->shards[s].answer, "%d", &budget);
+    }
+    return budget;
+}
+
+/**
+ * Takes a step of aging out after a movement, as a single process
+ * does, over the parks of every worker, starting one park further
+ * than the last step.
+*/
+void route_retention_step(router_t* router) {
+    int first, budget;
+
+    if (!router->retention_days || !router->num_parks) return;
+    first = router->retention_next % router->num_parks;
+    budget = route_retention_parks(router, first, router->num_parks,
+     RETENTION_STEP);
+    route_retention_parks(router, 0, first, budget);
+    router->retention_next = first + 1;
+}
+
+/* Keeping the system wide state */
+
+/**
+ * Parses the park name at the start of the arguments of a command.
+ * Returns the worker that owns it, or the first one if the name is
+ * invalid (any worker gives the same error), leaving the name
+ * empty in that case.
+*/
+int name_shard(router_t* router, char* args, char* name) {
+    while (*args == ' ' || *args == '\t') args++;
+    if (!parse_line_name(args, name)) {
+        name[0] = '\0';
+        return 0;
+    }
+    return park_shard(router, name);
+}
+
+/**
+ * Returns the index of a park in the router's list,
+ * or INVALID if there is none with that name.
+*/
+int find_router_park(router_t* router, char* name) {
+    for (int i = 0; i < router->num_parks; i++) {
+        if (!strcmp(router->park_names[i], name)) return i;
+    }
+    return INVALID;
+}
+
+/**
+ * Returns the index of the park whose name starts the given line
+ * of an answer, followed by a space or a colon, or INVALID.
+ * The longest name wins, since a name can be a prefix of another.
+*/
+int line_park(router_t* router, char* line) {
+    int found = INVALID, found_len = -1;
+    for (int i = 0; i < router->num_parks; i++) {
+        int len = strlen(router->park_names[i]);
+        if (len > found_len && !strncmp(line, router->park_names[i], len) &&
+            (line[len] == ' ' || line[len] == ':')) {
+            found = i;
+            found_len = len;
+        }
+    }
+    return found;
+}
+
+/**
+ * Checks whether the vehicle with the given plate is in a park
+ * that is not owned by the given worker.
+*/
+int vehicle_elsewhere(router_t* router, char* plate, int s) {
+    vehicle_t* vhc = search_ht(router->vehicles, plate);
+    if (!vhc || vhc->id == INVALID) return FALSE;
+    for (int i = 0; i < router->num_parks; i++) {
+        if (router->park_serials[i] == vhc->id)
+            return router->park_shards[i] != s;
+    }
+    return FALSE;
+}
+
+/**
+ * Records that a vehicle entered the park with the given
+ * serial, or left its park if the serial is INVALID.
+*/
+void track_vehicle(router_t* router, char* plate, int serial) {
+    vehicle_t* vhc = search_ht(router->vehicles, plate);
+    if (!vhc) {
+        int scope = mem_scope(MEM_VEHICLES);
+        vhc = (vehicle_t*)safe_malloc(sizeof(vehicle_t));
+        memset(vhc, 0, sizeof(vehicle_t));
+        strcpy(vhc->license_plate, plate);
+        insert_ht(router->vehicles, vhc);
+        mem_scope(scope);
+    }
+    vhc->id = serial;
+}
+
+/**
+ * Records a park created by the given worker.
+*/
+void add_router_park(router_t* router, char* name, int s) {
+    int i = router->num_parks++;
+    router->park_names[i] = duplicate_string(name);
+    router->park_shards[i] = s;
+    router->park_serials[i] = router->next_serial++;
+}
+
+/**
+ * Forgets a removed park, releasing the vehicles that were in it.
+*/
+void remove_router_park(router_t* router, int i) {
+    hash_table* vehicles = router->vehicles;
+    for (int b = 0; b < vehicles->size; b++) {
+        node_h* current = vehicles->table[b];
+        for (; current != NULL; current = current->next) {
+            if (current->vehicle->id == router->park_serials[i])
+                current->vehicle->id = INVALID;
+        }
+    }
+    safe_free(router->park_names[i]);
+    router->num_parks--;
+    for (; i < router->num_parks; i++) {
+        router->park_names[i] = router->park_names[i + 1];
+        router->park_shards[i] = router->park_shards[i + 1];
+        router->park_serials[i] = router->park_serials[i + 1];
+    }
+}
+
+/* Merging answers */
+
+/**
+ * Checks whether every worker gave the same answer,
+ * as they do for errors found before looking at any park.
+*/
+int same_answers(router_t* router) {
+    for (int s = 1; s < router->num_shards; s++) {
+        if (strcmp(router->shards[s].answer, router->shards[0].answer))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Returns the line of a worker's answer at the cursor,
+ * copied into line, moving the cursor past it.
+ * Returns NULL at the end of the answer.
+*/
+char* next_answer_line(char* answer, int* cursor, char* line) {
+    char* start = answer + *cursor;
+    char* end = strchr(start, '\n');
+    int len = end ? end - start + 1 : (int)strlen(start);
+    if (len == 0) return NULL;
+    memcpy(line, start, len);
+    line[len] = '\0';
+    *cursor += len;
+    return line;
+}
+
+/**
+ * Prints the answers to 'p' in order of creation of the parks,
+ * each worker having listed its own parks in that order.
+*/
+void print_by_creation(router_t* router, char* line) {
+    int cursors[MAX_SHARDS] = {0};
+    for (int i = 0; i < router->num_parks; i++) {
+        int s = router->park_shards[i];
+        if (next_answer_line(router->shards[s].answer, &cursors[s], line))
+            fputs(line, stdout);
+    }
+}
+
+/* qsort gives no context to the comparison, so the router is kept here */
+static router_t* sorting_router;
+
+/**
+ * Compares the names of two parks of the router, by their index.
+*/
+int compare_router_parks(const void* p1, const void* p2) {
+    return strcmp(sorting_router->park_names[*(const int*)p1],
+     sorting_router->park_names[*(const int*)p2]);
+}
+
+/**
+ * Fills order with the indexes of the parks sorted by name.
+*/
+void sort_router_parks(router_t* router, int* order) {
+    for (int i = 0; i < router->num_parks; i++) {
+        order[i] = i;
+    }
+    sorting_router = router;
+    qsort(order, router->num_parks, sizeof(int), compare_router_parks);
+}
+
+/**
+ * Prints answers made of lines that start with a park name and
+ * are sorted by park name in each worker ('v' and 'n'), merging
+ * them by park name. Answers that are not about any park (like a
+ * vehicle with no entries in that worker) are left out, unless
+ * every worker gave the same one.
+*/
+void print_by_name(router_t* router, char* line) {
+    int cursors[MAX_SHARDS] = {0}, order[MAX_P];
+
+    if (same_answers(router)) {
+        fputs(router->shards[0].answer, stdout);
+        return;
+    }
+    sort_router_parks(router, order);
+    for (int k = 0; k < router->num_parks; k++) {
+        int i = order[k], s = router->park_shards[i];
+        char* answer = router->shards[s].answer;
+        int cursor = cursors[s];
+        while (next_answer_line(answer, &cursor, line) &&
+            line_park(router, line) == i) {
+            fputs(line, stdout);
+            cursors[s] = cursor;
+        }
+    }
+}
+
+/**
+ * Prints the revenue reports of the workers ('c') merged: the
+ * section of each park, its name and total followed by its days,
+ * in name order, then the totals of the workers added up.
+*/
+void print_merged_report(router_t* router, char* line) {
+    int cursors[MAX_SHARDS] = {0}, order[MAX_P];
+    long long total = 0, euros, cents;
+
+    sort_router_parks(router, order);
+    for (int k = 0; k < router->num_parks; k++) {
+        int s = router->park_shards[order[k]];
+        char* answer = router->shards[s].answer;
+        if (!next_answer_line(answer, &cursors[s], line)) continue;
+        fputs(line, stdout);
+        int cursor = cursors[s];
+        while (next_answer_line(answer, &cursor, line) &&
+            is_digit(*line) && strchr(line, ' ')) {
+            fputs(line, stdout);
+            cursors[s] = cursor;
+        }
+    }
+    for (int s = 0; s < router->num_shards; s++) {
+        if (next_answer_line(router->shards[s].answer, &cursors[s], line) &&
+            sscanf(line, "%lld.%2lld", &euros, &cents) == 2)
+            total += euros * 100 + cents;
+    }
+    printf("%lld.%02lld\n", total / 100, total % 100);
+}
+
+/**
+ * Reads the entry minute and license plate at the start of a line
+ * of the answer to 'a'. Returns FALSE if the line is not an alert.
+*/
+int alert_line_key(char* line, int* minute, char* plate) {
+    timestamp_t entry;
+    return sscanf(line, "%8s %d-%d-%d %d:%d", plate, &entry.d, &entry.mth,
+     &entry.y, &entry.h, &entry.min) == 6 &&
+     (*minute = get_minute_index(entry)) >= 0;
+}
+
+/**
+ * Prints the answers to 'a' merged by entry date and license
+ * plate, the order of each worker's answer since all of them
+ * have the same threshold, or the first answer if one of them
+ * is not a list of alerts (an error every worker gives alike).
+*/
+void print_by_entry(router_t* router, char* line) {
+    int cursors[MAX_SHARDS] = {0}, best, best_minute = 0, minute;
+    char plate[V_LICENSE_PLT_LENGTH], best_plate[V_LICENSE_PLT_LENGTH];
+
+    for (int s = 0; s < router->num_shards; s++) {
+        char* answer = router->shards[s].answer;
+        if (*answer && !alert_line_key(answer, &minute, plate)) {
+            fputs(router->shards[0].answer, stdout);
+            return;
+        }
+    }
+    do {
+        best = -1;
+        for (int s = 0; s < router->num_shards; s++) {
+            char* answer = router->shards[s].answer + cursors[s];
+            if (!*answer || !alert_line_key(answer, &minute, plate))
+                continue;
+            if (best < 0 || minute < best_minute || (minute ==
+                best_minute && strcmp(plate, best_plate) < 0)) {
+                best = s;
+                best_minute = minute;
+                strcpy(best_plate, plate);
+            }
+        }
+        if (best >= 0 && next_answer_line(router->shards[best].answer,
+            &cursors[best], line))
+            fputs(line, stdout);
+    } while (best >= 0);
+}
+
+/**
+ * Prints the sum of answers that are a single value
+ * in euros ('u' and 'g'), or the first answer if one of
+ * them is not (an error every worker gives alike).
+*/
+void print_sum(router_t* router) {
+    long long total = 0, euros, cents;
+    int len;
+
+    for (int s = 0; s < router->num_shards; s++) {
+        char* answer = router->shards[s].answer;
+        if (sscanf(answer, "%lld.%2lld\n%n", &euros, &cents, &len) != 2 ||
+            len != router->shards[s].answer_len) {
+            fputs(router->shards[0].answer, stdout);
+            return;
+        }
+        total += euros * 100 + cents;
+    }
+    printf("%lld.%02lld\n", total / 100, total % 100);
+}
+
+/**
+ * Prints the estimate of the sketches of the workers merged
+ * ('h'), or the first answer if one of them is not a sketch
+ * (an error every worker gives alike).
+*/
+void print_merged_sketches(router_t* router) {
+    hll_t* merged = init_hll();
+    hll_t* sketch = init_hll();
+
+    for (int s = 0; s < router->num_shards; s++) {
+        if (!read_hll(sketch, router->shards[s].answer)) {
+            fputs(router->shards[0].answer, stdout);
+            safe_free(sketch);
+            safe_free(merged);
+            return;
+        }
+        hll_merge(merged, sketch);
+    }
+    printf("%lld\n", hll_estimate(merged));
+    safe_free(sketch);
+    safe_free(merged);
+}
+
+/**
+ * Prints the percentiles of the histograms of the workers added
+ * up ('d'), or the first answer if one of them is not a histogram
+ * (an error every worker gives alike).
+*/
+void print_merged_histograms(router_t* router) {
+    duration_histogram_t* merged = init_histogram();
+    duration_histogram_t* histogram = init_histogram();
+
+    for (int s = 0; s < router->num_shards; s++) {
+        if (!read_histogram(histogram, router->shards[s].answer)) {
+            fputs(router->shards[0].answer, stdout);
+            safe_free(histogram);
+            safe_free(merged);
+            return;
+        }
+        histogram_merge(merged, histogram);
+    }
+    print_percentiles(merged);
+    safe_free(histogram);
+    safe_free(merged);
+}
+
+/**
+ * Prints the memory reports of the workers added up, line by
+ * line, or their common answer when they all gave the same one.
+ * The budget is not added up, since every worker has its own.
+*/
+void print_memory_sum(router_t* router, char* line) {
+    int cursors[MAX_SHARDS] = {0};
+    char label[MAX_LINE_SIZE];
+    long long value, total;
+
+    if (same_answers(router)) {
+        fputs(router->shards[0].answer, stdout);
+        return;
+    }
+    while (next_answer_line(router->shards[0].answer, &cursors[0], line)) {
+        if (sscanf(line, "%s %lld", label, &total) != 2) continue;
+        for (int s = 1; s < router->num_shards; s++) {
+            if (next_answer_line(router->shards[s].answer, &cursors[s], line)
+                && sscanf(line, "%*s %lld", &value) == 1 &&
+                strcmp(label, "budget"))
+                total += value;
+        }
+        printf("%s %lld\n", label, total);
+    }
+}
+
+/**
+ * Prints the system leaderboards, built from the totals every
+ * worker keeps for its own parks, added up by vehicle.
+*/
+void print_router_leaderboards(router_t* router, int count, char* line) {
+    hash_table* totals = init_ht();
+    leaderboard_t* top_paid = init_leaderboard();
+    leaderboard_t* top_visits = init_leaderboard();
+    vehicle_t** vehicles = NULL;
+    int num_vehicles = 0, capacity = 0, visits;
+    char plate[MAX_LINE_SIZE], request[2] = {ROUTER_TOTALS, '\0'};
+    long long cents;
+
+    route_all(router, request);
+    for (int s = 0; s < router->num_shards; s++) {
+        int cursor = 0;
+        while (next_answer_line(router->shards[s].answer, &cursor, line)) {
+            if (sscanf(line, "%s %lld %d", plate, &cents, &visits) != 3)
+                continue;
+            vehicle_t* vhc = search_ht(totals, plate);
+            if (!vhc) {
+                vhc = (vehicle_t*)safe_malloc(sizeof(vehicle_t));
+                memset(vhc, 0, sizeof(vehicle_t));
+                strcpy(vhc->license_plate, plate);
+                insert_ht(totals, vhc);
+                if (num_vehicles == capacity) {
+                    capacity = capacity ? 2 * capacity : HASH_TABLE_SIZE;
+                    vehicles = (vehicle_t**)safe_realloc(vehicles,
+                     capacity * sizeof(vehicle_t*));
+                }
+                vehicles[num_vehicles++] = vhc;
+            }
+            vhc->total_cents += cents;
+            vhc->total_visits += visits;
+        }
+    }
+    for (int i = 0; i < num_vehicles; i++) {
+        leaderboard_update(top_paid, vehicles[i], vehicles[i]->total_cents);
+        leaderboard_update(top_visits, vehicles[i],
+         vehicles[i]->total_visits);
+    }
+    print_leaderboards(top_paid, top_visits, count);
+    safe_free(vehicles);
+    safe_free(top_paid);
+    safe_free(top_visits);
+    free_hashtable(totals);
+}
+
+/* Routing commands */
+
+/**
+ * Skips the spaces at the start of the arguments of a command.
+ * Returns TRUE if there is anything after them on the line.
+*/
+int has_args(char* args) {
+    args += strspn(args, " \t");
+    return *args != '\n' && *args != '\0';
+}
+
+/**
+ * Routes a command with a park name to the worker owning the park.
+*/
+void route_park_command(router_t* router, char* command, char* name) {
+    int s = name_shard(router, command + 1, name);
+    route_to(router, s, command, FALSE);
+    fputs(router->shards[s].answer, stdout);
+}
+
+/**
+ * Routes an 'h' or 'd' command. A park goes to the worker that
+ * owns it, while every park needs the sketches of every worker
+ * merged, since a vehicle may have entered parks of several workers.
+*/
+void route_sketch_query(router_t* router, char* command, char* name) {
+    char request[MAX_LINE_SIZE + 1];
+
+    if (has_args(command + 1) &&
+        !is_digit(command[1 + strspn(command + 1, " \t")])) {
+        route_park_command(router, command, name);
+        return;
+    }
+    request[0] = ROUTER_SKETCH;
+    strcpy(request + 1, command);
+    route_all(router, request);
+    if (*command == VISITORS_COMMAND)
+        print_merged_sketches(router);
+    else
+        print_merged_histograms(router);
+}
+
+/**
+ * Routes a 'p' command. Listing the parks needs every worker,
+ * a new park goes to the worker that owns it.
+*/
+void route_create_park(router_t* router, char* command, char* name) {
+    if (!has_args(command + 1)) {
+        route_all(router, command);
+        print_by_creation(router, name);
+        return;
+    }
+    int s = name_shard(router, command + 1, name);
+    route_to(router, s, command, FALSE);
+    fputs(router->shards[s].answer, stdout);
+    if (router->shards[s].num_parks > router->num_parks)
+        add_router_park(router, name, s);
+}
+
+/**
+ * Routes an 'e' or 's' command to the worker owning its park,
+ * telling it on an entry if the vehicle is in another worker's
+ * park, and keeping track of where the vehicle is.
+*/
+void route_movement(router_t* router, char* command, char* name) {
+    char plate[BULK_PLATE_SIZE] = "";
+    int s = name_shard(router, command + 1, name), elsewhere = FALSE;
+    char* args = command + 1 + strspn(command + 1, " \t");
+
+    if (name[0]) {
+        args = parse_line_name(args, name);
+        sscanf(args, "%15s", plate);
+        elsewhere = command[0] == ENTRY_COMMAND &&
+         vehicle_elsewhere(router, plate, s);
+    }
+    long long movements = router->shards[s].num_movements;
+    route_to(router, s, command, elsewhere);
+    fputs(router->shards[s].answer, stdout);
+
+    if (router->shards[s].num_movements != movements) {
+        int i = find_router_park(router, name);
+        track_vehicle(router, plate, command[0] == ENTRY_COMMAND ?
+         router->park_serials[i] : INVALID);
+        route_retention_step(router);
+    }
+}
+
+/**
+ * Routes an 'r' command to the worker owning the park. The worker
+ * only lists its own parks, so the router lists all of them.
+*/
+void route_remove_park(router_t* router, char* command, char* name) {
+    int order[MAX_P];
+    int s = name_shard(router, command + 1, name);
+
+    route_to(router, s, command, FALSE);
+    if (router->shards[s].num_parks == router->num_parks) {
+        fputs(router->shards[s].answer, stdout);
+        return;
+    }
+    remove_router_park(router, find_router_park(router, name));
+    sort_router_parks(router, order);
+    for (int k = 0; k < router->num_parks; k++) {
+        printf("%s\n", router->park_names[order[k]]);
+    }
+}
+
+/**
+ * Routes a 't' command. A park's leaderboards are in the worker
+ * owning it, the system ones are built from every worker.
+*/
+void route_leaderboards(router_t* router, char* command, char* name) {
+    char* args = command + 1 + strspn(command + 1, " \t");
+    int count = 0;
+
+    if (has_args(args) && !is_digit(*args) && *args != '-') {
+        route_park_command(router, command, name);
+        return;
+    }
+    if (!has_args(args) || sscanf(args, "%d", &count) != 1 ||
+        count <= 0 || count > TOPK_MAX) {
+        printf(TOPK_INVALID_COUNT, count);
+        return;
+    }
+    print_router_leaderboards(router, count, name);
+}
+
+/**
+ * Gives a line of movements to the worker owning its park,
+ * counting it as loaded or rejected by the worker.
+*/
+void route_feed_line(router_t* router, bulk_record_t* rec, char* line,
+                      bulk_stats_t* stats) {
+    char request[MAX_LINE_SIZE + 16];
+    int s = rec->park_name ? park_shard(router, rec->park_name) : 0;
+    int elsewhere = rec->op == ENTRY_COMMAND &&
+     vehicle_elsewhere(router, rec->plate, s);
+    long long movements = router->shards[s].num_movements;
+
+    snprintf(request, sizeof(request), "%c%d %s", ROUTER_BULK_LINE,
+     rec->line, line);
+    route_to(router, s, request, elsewhere);
+    if (router->shards[s].num_movements == movements) {
+        if (rec->source) printf(MERGE_SOURCE, rec->source);
+        stats->rejected++;
+        fputs(router->shards[s].answer, stdout);
+        return;
+    }
+    int i = find_router_park(router, rec->park_name);
+    track_vehicle(router, rec->plate, rec->op == ENTRY_COMMAND ?
+     router->park_serials[i] : INVALID);
+    stats->loaded++;
+    fputs(router->shards[s].answer, stdout);
+    route_retention_step(router);
+}
+
+/**
+ * Gives each line of a file of movements to the worker owning
+ * its park, in order, counting the lines the workers reject.
+*/
+void route_feed(router_t* router, FILE* file, bulk_stats_t* stats,
+                 char* name) {
+    char line[MAX_LINE_SIZE];
+    bulk_record_t rec;
+    int line_num = 0;
+
+    while (fgets(line, MAX_LINE_SIZE, file)) {
+        line_num++;
+        if (is_blank_line(line)) continue;
+        read_record(&rec, line, line_num, name);
+        route_feed_line(router, &rec, line, stats);
+        safe_free(rec.park_name);
+    }
+}
+
+/**
+ * Routes a 'b' command. The router reads the files, merging
+ * them if there are several, and routes their lines, then
+ * prints the summary.
+*/
+void route_bulk_load(router_t* router, char* command, char* name) {
+    char* paths[MERGE_MAX_FEEDS];
+    char* args = command + 1;
+    bulk_stats_t stats = {0, 0};
+    merge_feed_t* feed;
+    int num_paths = 0, len;
+
+    while (num_paths < MERGE_MAX_FEEDS &&
+        sscanf(args, "%s%n", name, &len) == 1) {
+        paths[num_paths++] = duplicate_string(name);
+        args += len;
+    }
+    if (!num_paths) {
+        printf(BULK_NO_FILE, "");
+        return;
+    }
+    merge_t* merge = merge_open(paths, num_paths);
+    if (merge) {
+        while ((feed = merge_next(merge)))
+            route_feed_line(router, &feed->rec, feed->line, &stats);
+        printf(BULK_SUMMARY, stats.loaded, stats.rejected);
+        merge_close(merge);
+    }
+    for (int i = 0; i < num_paths; i++) {
+        safe_free(paths[i]);
+    }
+}
+
+/**
+ * Routes an 'i' command. The workers already run in parallel, so
+ * the router routes the lines of one feed after the other, which
+ * is one of the orders the feeds could have arrived in.
+*/
+void route_gate_feeds(router_t* router, char* command, char* name) {
+    char path[MAX_LINE_SIZE];
+    char* args = command + 1;
+    int num_feeds = 0, len;
+
+    while (num_feeds < GATE_MAX_FEEDS &&
+        sscanf(args, "%s%n", path, &len) == 1) {
+        bulk_stats_t stats = {0, 0};
+        FILE* file = fopen(path, "r");
+        args += len;
+        num_feeds++;
+        if (!file) {
+            printf(BULK_NO_FILE, path);
+            continue;
+        }
+        route_feed(router, file, &stats, name);
+        printf(GATE_SUMMARY, path, stats.loaded, stats.rejected);
+        fclose(file);
+    }
+    if (!num_feeds) printf(GATE_NO_FEEDS);
+}
+
+/**
+ * Routes a 'k' command to every worker, keeping the retention
+ * period the router steps them with if they took it.
+*/
+void route_retention(router_t* router, char* command) {
+    route_all(router, command);
+    if (!router->shards[0].answer_len)
+        sscanf(command + 1, "%d", &router->retention_days);
+    fputs(router->shards[0].answer, stdout);
+}
+
+/**
+ * Returns the number of subscribers of the whole system: those to
+ * every park are subscribed in every worker, and those to one park
+ * only in the worker that owns it.
+*/
+int router_subscribers(router_t* router) {
+    int all = 0, parks = 0;
+    for (int s = 0; s < router->num_shards; s++) {
+        if (router->shards[s].all_subscribers > all)
+            all = router->shards[s].all_subscribers;
+        parks += router->shards[s].park_subscribers;
+    }
+    return all + parks;
+}
+
+/**
+ * Routes a 'z' command. A subscription to a park goes to the
+ * worker that owns it, one to every park goes to every worker,
+ * each sending the changes of its own parks. The limit is for the
+ * whole system, so the router checks it, and an error of any
+ * worker is the error of the subscription.
+*/
+void route_subscribe(router_t* router, char* command, char* name) {
+    char* args = command + 1;
+    int len;
+
+    if (!has_args(args) || sscanf(args, "%s%n", name, &len) != 1) {
+        printf(EVENTS_INVALID);
+        return;
+    }
+    if (has_args(args + len)) {
+        int s = name_shard(router, args + len, name);
+        if (name[0] && find_router_park(router, name) != INVALID &&
+            router_subscribers(router) == EVENTS_MAX_SUBSCRIBERS) {
+            printf(EVENTS_TOO_MANY);
+            return;
+        }
+        route_to(router, s, command, FALSE);
+        fputs(router->shards[s].answer, stdout);
+        return;
+    }
+    if (router_subscribers(router) == EVENTS_MAX_SUBSCRIBERS) {
+        printf(EVENTS_TOO_MANY);
+        return;
+    }
+    route_all(router, command);
+    for (int s = 0; s < router->num_shards; s++) {
+        if (router->shards[s].answer_len) {
+            fputs(router->shards[s].answer, stdout);
+            return;
+        }
+    }
+}
+
+/**
+ * Routes a 'y' command. The state lives in the workers, so the
+ * router answers the query itself, with its output going to the
+ * file, before reading the next command.
+*/
+void route_snapshot(router_t* router, char* command, char* name) {
+    char path[MAX_LINE_SIZE];
+    char* query;
+
+    if (!has_args(command + 1) || sscanf(command + 1, "%s", path) != 1) {
+        printf(SNAPSHOT_INVALID);
+        return;
+    }
+    query = strstr(command + 1, path) + strlen(path);
+    query += strspn(query, " \t");
+    if (*query == '\n' || *query == '\0') {
+        printf(SNAPSHOT_INVALID);
+        return;
+    }
+    if (!is_query_command(query[0])) {
+        printf(SNAPSHOT_NOT_QUERY, query[0]);
+        return;
+    }
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        printf(SNAPSHOT_NO_FILE, path);
+        return;
+    }
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(fileno(out), STDOUT_FILENO);
+    route_line(router, query, name);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    fclose(out);
+}
+
+/**
+ * Routes an 'x' command. A park goes to the worker that owns it,
+ * while every park is exported by every worker to a file of its
+ * own, the given path followed by the number of the worker.
+ * A worker that cannot open its file fails the whole export.
+*/
+void route_export(router_t* router, char* command, char* name) {
+    char path[MAX_LINE_SIZE], request[2 * MAX_LINE_SIZE];
+    char* args = command + 1;
+    int offset, watermark, s;
+
+    if (!has_args(args) || sscanf(args, "%s%n", path, &offset) != 1 ||
+        sscanf(args + offset, "%d", &watermark) != 1 || watermark < 0) {
+        route_to(router, 0, command, FALSE);
+        fputs(router->shards[0].answer, stdout);
+        return;
+    }
+    args += offset;
+    sscanf(args, "%*d%n", &offset);
+    if (has_args(args + offset)) {
+        s = name_shard(router, args + offset, name);
+        route_to(router, s, command, FALSE);
+        fputs(router->shards[s].answer, stdout);
+        return;
+    }
+    for (s = 0; s < router->num_shards; s++) {
+        snprintf(request, sizeof(request), "%c %s.%d%s", EXPORT_COMMAND,
+         path, s, args);
+        shard_send(router, s, request, FALSE);
+    }
+    for (s = 0; s < router->num_shards; s++) {
+        shard_receive(router, s);
+    }
+    for (s = 0; s < router->num_shards; s++) {
+        if (sscanf(router->shards[s].answer, EXPORT_WATERMARK,
+            &watermark) != 1) {
+            printf(SNAPSHOT_NO_FILE, path);
+            return;
+        }
+    }
+    fputs(router->shards[0].answer, stdout);
+}
+
+/**
+ * Routes every command of an input line, skipping the characters
+ * that are not commands as a single process does.
+ * Returns FALSE on the quit command.
+*/
+int route_line(router_t* router, char* line, char* name) {
+    char* command = line + strspn(line, " \t\n");
+    if (*command == '\0') return TRUE;
+
+    switch (*command) {
+        case QUIT_COMMAND:
+            return FALSE;
+        case PARK_COMMAND:
+            route_create_park(router, command, name);
+            break;
+        case ENTRY_COMMAND:
+        case EXIT_COMMAND:
+            route_movement(router, command, name);
+            break;
+        case VEHICLE_COMMAND:
+        case DIRECTORY_COMMAND:
+            route_all(router, command);
+            print_by_name(router, name);
+            break;
+        case PAID_COMAMND:
+            route_all(router, command);
+            print_sum(router);
+            break;
+        case REVENUE_COMMAND:
+            if (has_args(command + 1) &&
+                !is_digit(command[1 + strspn(command + 1, " \t")])) {
+                route_park_command(router, command, name);
+            } else {
+                route_all(router, command);
+                print_sum(router);
+            }
+            break;
+        case VISITORS_COMMAND:
+        case DURATIONS_COMMAND:
+            route_sketch_query(router, command, name);
+            break;
+        case FACT_COMMAND:
+        case OCCUPANTS_COMMAND:
+        case OCCUPANCY_COMMAND:
+        case PRESENT_COMMAND:
+            route_park_command(router, command, name);
+            break;
+        case REMOVE_COMMAND:
+            route_remove_park(router, command, name);
+            break;
+        case TOP_COMMAND:
+            route_leaderboards(router, command, name);
+            break;
+        case RETENTION_COMMAND:
+            route_retention(router, command);
+            break;
+        case MEMORY_COMMAND:
+            route_all(router, command);
+            print_memory_sum(router, name);
+            break;
+        case BULK_COMMAND:
+            route_bulk_load(router, command, name);
+            break;
+        case SNAPSHOT_COMMAND:
+            route_snapshot(router, command, name);
+            break;
+        case GATES_COMMAND:
+            route_gate_feeds(router, command, name);
+            break;
+        case EXPORT_COMMAND:
+            route_export(router, command, name);
+            break;
+        case ALERT_COMMAND:
+            route_all(router, command);
+            print_by_entry(router, name);
+            break;
+        case REPORT_COMMAND:
+            route_all(router, command);
+            print_merged_report(router, name);
+            break;
+        case SUBSCRIBE_COMMAND:
+            route_subscribe(router, command, name);
+            break;
+        default:
+            return route_line(router, command + 1, name);
+    }
+    return TRUE;
+}
+
+/* Workers */
+
+/**
+ * Applies the system wide state sent by the router.
+*/
+void apply_context(char* context, system_t* sys) {
+    timestamp_t* date = &sys->date_registry;
+    sscanf(context, "%d %d %d %d %d %d %d", &date->y, &date->mth,
+     &date->d, &date->h, &date->min, &sys->num_parks,
+     &sys->entry_elsewhere);
+}
+
+/**
+ * Prints the totals of every vehicle that left a park of this
+ * worker, for the router to build the system leaderboards.
+*/
+void print_vehicle_totals(system_t* sys) {
+    for (int i = 0; i < sys->num_vehicles; i++) {
+        vehicle_t* vhc = sys->vehicle_ids[i];
+        if (vhc->total_visits > 0)
+            printf("%s %lld %d\n", vhc->license_plate, vhc->total_cents,
+             vhc->total_visits);
+    }
+}
+
+/**
+ * Runs the commands of a request line, reading them from memory,
+ * so a command missing arguments cannot wait for the next line.
+*/
+void run_request(char* request, system_t* sys, char* buffer) {
+    FILE* requests = stdin;
+    int c;
+
+    stdin = fmemopen(request, strlen(request), "r");
+    if (stdin) {
+        while ((c = getchar()) != EOF && command_processor(c, sys, buffer));
+        fclose(stdin);
+    }
+    stdin = requests;
+}
+
+/**
+ * Main loop of a worker: answers the requests of the router, one
+ * line at a time, ending each answer with a status line with the
+ * state of the system the router needs to know.
+*/
+void worker_loop(system_t* sys, char* buffer) {
+    char* line = (char*)safe_malloc(MAX_LINE_SIZE);
+    bulk_chunk_t* chunk = (bulk_chunk_t*)safe_malloc(sizeof(bulk_chunk_t));
+    bulk_stats_t stats = {0, 0};
+    int line_num, offset, first, count, budget;
+
+    while (fgets(line, MAX_LINE_SIZE, stdin)) {
+        if (line[0] == ROUTER_CONTEXT) {
+            apply_context(line + 1, sys);
+            continue;
+        }
+        if (line[0] == ROUTER_BULK_LINE &&
+            sscanf(line + 1, "%d %n", &line_num, &offset) == 1)
+            bulk_line(chunk, line + 1 + offset, line_num, &stats, sys);
+        else if (line[0] == ROUTER_TOTALS)
+            print_vehicle_totals(sys);
+        else if (line[0] == ROUTER_RETENTION &&
+            sscanf(line + 1, "%d %d %d", &first, &count, &budget) == 3)
+            printf("%d\n", retention_parks(sys, first, count, budget));
+        else if (line[0] == ROUTER_SKETCH) {
+            sys->raw_sketches = TRUE;
+            run_request(line + 1, sys, buffer);
+            sys->raw_sketches = FALSE;
+        }
+        else
+            run_request(line, sys, buffer);
+
+        pump_events(sys);
+        sys->entry_elsewhere = FALSE;
+        printf("%c%d %d %d %d %d %d %lld %d %d\n", ROUTER_STATUS,
+         sys->date_registry.y, sys->date_registry.mth,
+         sys->date_registry.d, sys->date_registry.h,
+         sys->date_registry.min, sys->num_parks, sys->num_movements,
+         count_subscribers(sys->events, INVALID),
+         sys->events->num_subscribers -
+         count_subscribers(sys->events, INVALID));
+        fflush(stdout);
+    }
+    safe_free(chunk);
+    safe_free(line);
+}
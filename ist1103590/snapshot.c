@@ -0,0 +1,83 @@
+/**
+ * @file snapshot.c
+ * 
+ * @author Tiago Firmino - ist1103590
+ * 
+ * File containing functions used to answer queries from a
+ * snapshot of the system. The process is forked and the child,
+ * which sees the system as it was at that moment through its
+ * copy-on-write memory, runs the query with the usual command
+ * code and writes its output to a file, while the parent goes
+ * on processing commands.
+ * 
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/**
+ * Checks whether a command only reads the system,
+ * and so can be answered from a snapshot.
+*/
+int is_query_command(char command) {
+    return command != '\0' && strchr(SNAPSHOT_QUERIES, command) != NULL;
+}
+
+/**
+ * Forks a child process that sees the system as it is now,
+ * collecting the snapshots that already finished first.
+ * Returns the result of fork, printing the error if it failed.
+*/
+int fork_snapshot() {
+    reap_snapshots();
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) printf(SNAPSHOT_FAILED);
+    return pid;
+}
+
+/**
+ * Runs a query command line in a child process, with its output
+ * going to the given file. The child reads the line from memory,
+ * not from the standard input the parent keeps reading, and
+ * leaves with _exit so it never touches the parent's streams.
+*/
+void run_snapshot(char* path, char* line, system_t* sys, char* buffer) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        printf(SNAPSHOT_NO_FILE, path);
+        return;
+    }
+    if (fork_snapshot() == 0) {
+        FILE* in = fmemopen(line, strlen(line), "r");
+        if (!in || dup2(fileno(out), STDOUT_FILENO) < 0)
+            _exit(EXIT_FAILURE);
+        stdin = in;
+        command_processor(getchar(), sys, buffer);
+        fflush(stdout);
+        _exit(EXIT_SUCCESS);
+    }
+    fclose(out);
+}
+
+/**
+ * Collects the snapshots that already finished, without waiting.
+*/
+void reap_snapshots() {
+    while (waitpid(-1, NULL, WNOHANG) > 0);
+}
+
+/**
+ * Waits for every snapshot still running, so that their files
+ * are complete when the program ends.
+*/
+void wait_snapshots() {
+    while (wait(NULL) > 0);
+}
@@ -0,0 +1,227 @@
+/**
+ * @file stays.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing the index of the stays of each park, used to
+ * tell which vehicles were in a park at a given time, or at some
+ * point between two times. A vehicle still parked is in the park's
+ * list of vehicles, in entry order. A completed stay is appended
+ * to the index on exit, so the index is in exit order: the stays
+ * that ended after a time are found by binary search, and a
+ * segment tree of the earliest entry prunes those that had not
+ * started yet, reaching each stay that overlaps the time without
+ * going through the others.
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+/**
+ * Creates a new empty index of stays.
+*/
+stay_index_t* init_stay_index() {
+    stay_index_t* index = (stay_index_t*)safe_malloc(sizeof(stay_index_t));
+    index->capacity = STAY_INDEX_INIT;
+    index->stays = (closed_stay_t*)safe_malloc(
+     index->capacity * sizeof(closed_stay_t));
+    index->min_entry = (int*)safe_malloc(2 * index->capacity * sizeof(int));
+    index->first = 0;
+    index->size = 0;
+    index->horizon = 0;
+    rebuild_stay_tree(index);
+    return index;
+}
+
+/**
+ * Frees an index of stays.
+*/
+void free_stay_index(stay_index_t* index) {
+    safe_free(index->stays);
+    safe_free(index->min_entry);
+    safe_free(index);
+}
+
+/**
+ * Rebuilds the segment tree of an index from its stays.
+*/
+void rebuild_stay_tree(stay_index_t* index) {
+    int* tree = index->min_entry;
+    for (int i = 0; i < index->capacity; i++) {
+        tree[index->capacity + i] = i < index->size ?
+         index->stays[i].entry_time : INT_MAX;
+    }
+    for (int node = index->capacity - 1; node > 0; node--) {
+        tree[node] = tree[2 * node] < tree[2 * node + 1] ?
+         tree[2 * node] : tree[2 * node + 1];
+    }
+}
+
+/**
+ * Makes room for one more stay, dropping the aged out ones
+ * if they are at least half of the index, or else doubling it.
+*/
+void grow_stay_index(stay_index_t* index) {
+    if (index->first >= index->capacity / 2) {
+        index->size -= index->first;
+        memmove(index->stays, index->stays + index->first,
+         index->size * sizeof(closed_stay_t));
+        index->first = 0;
+    } else {
+        index->capacity *= 2;
+        index->stays = (closed_stay_t*)safe_realloc(index->stays,
+         index->capacity * sizeof(closed_stay_t));
+        index->min_entry = (int*)safe_realloc(index->min_entry,
+         2 * index->capacity * sizeof(int));
+    }
+    rebuild_stay_tree(index);
+}
+
+/**
+ * Adds a completed stay, that ended no earlier than
+ * the stays already in the index.
+*/
+void index_stay(stay_index_t* index, int entry_time, int exit_time,
+                  int vehicle_id) {
+    int scope = mem_scope(MEM_HISTORY);
+    if (index->size == index->capacity) grow_stay_index(index);
+    mem_scope(scope);
+
+    closed_stay_t* stay = &index->stays[index->size];
+    stay->entry_time = entry_time;
+    stay->exit_time = exit_time;
+    stay->vehicle_id = vehicle_id;
+
+    int node = index->capacity + index->size++;
+    index->min_entry[node] = entry_time;
+    for (node /= 2; node > 0; node /= 2) {
+        if (index->min_entry[node] <= entry_time) break;
+        index->min_entry[node] = entry_time;
+    }
+}
+
+/**
+ * Returns the position of the first stay of the index
+ * that ended after the given minute.
+*/
+int first_stay_after(stay_index_t* index, int minute) {
+    int lo = index->first, hi = index->size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (index->stays[mid].exit_time > minute)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+/**
+ * Forgets the stays that ended before the given minute.
+ * Their memory is given back the next time the index grows.
+*/
+void age_out_stays(stay_index_t* index, int cutoff) {
+    if (cutoff <= index->horizon) return;
+    index->first = first_stay_after(index, cutoff - 1);
+    index->horizon = cutoff;
+}
+
+/**
+ * Adds a vehicle that was in the park to the results,
+ * making room for it if needed.
+*/
+void add_present(present_t** present, int* count, int* capacity,
+                   vehicle_t* vhc, int entry_time, int exit_time) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? 2 * *capacity : STAY_INDEX_INIT;
+        *present = (present_t*)safe_realloc(*present,
+         *capacity * sizeof(present_t));
+    }
+    (*present)[*count].vehicle = vhc;
+    (*present)[*count].entry_time = entry_time;
+    (*present)[*count].exit_time = exit_time;
+    (*count)++;
+}
+
+/**
+ * Adds to the results the stays under a node of the segment tree,
+ * covering positions lo to hi (exclusive), that are at or after
+ * the given position and started no later than the given minute.
+*/
+void collect_stays(stay_index_t* index, int node, int lo, int hi,
+                     int from, int until, present_t** present, int* count,
+                     int* capacity, system_t* sys) {
+    if (hi <= from || index->min_entry[node] > until) return;
+    if (hi - lo == 1) {
+        closed_stay_t* stay = &index->stays[lo];
+        add_present(present, count, capacity,
+         sys->vehicle_ids[stay->vehicle_id], stay->entry_time,
+         stay->exit_time);
+        return;
+    }
+    int mid = (lo + hi) / 2;
+    collect_stays(index, 2 * node, lo, mid, from, until, present, count,
+     capacity, sys);
+    collect_stays(index, 2 * node + 1, mid, hi, from, until, present,
+     count, capacity, sys);
+}
+
+/**
+ * Compares vehicles that were in a park by entry, then by plate.
+*/
+int compare_present(const void* a, const void* b) {
+    present_t* present_a = (present_t*)a;
+    present_t* present_b = (present_t*)b;
+    if (present_a->entry_time != present_b->entry_time)
+        return present_a->entry_time < present_b->entry_time ? -1 : 1;
+    return strcmp(present_a->vehicle->license_plate,
+     present_b->vehicle->license_plate);
+}
+
+/**
+ * Shows the vehicles that were in a park at some point between
+ * two minutes (both inclusive), by entry, with their entry and,
+ * if they already left, their exit. A vehicle that left on a
+ * minute is no longer there on it.
+*/
+void print_present(park_t* park, int from, int to, system_t* sys) {
+    stay_index_t* index = park->stays;
+    present_t* present = NULL;
+    int count = 0, capacity = 0;
+
+    if (from < index->horizon) {
+        timestamp_t date = minute_to_timestamp(from);
+        printf(FACT_AGED_OUT, date.d, date.mth, date.y);
+        return;
+    }
+    collect_stays(index, 1, 0, index->capacity,
+     first_stay_after(index, from), to, &present, &count, &capacity, sys);
+    node_t* current = park->park_vehicles->head;
+    for (; current != NULL; current = current->next) {
+        vehicle_t* vhc = (vehicle_t*)current->val;
+        int entry_time = get_minute_index(vhc->last_entry);
+        if (entry_time > to) break;
+        add_present(&present, &count, &capacity, vhc, entry_time, -1);
+    }
+
+    if (count > 1)
+        qsort(present, count, sizeof(present_t), compare_present);
+    for (int i = 0; i < count; i++) {
+        timestamp_t entry = minute_to_timestamp(present[i].entry_time);
+        printf("%s %02d-%02d-%4d %02d:%02d",
+         present[i].vehicle->license_plate, entry.d, entry.mth, entry.y,
+         entry.h, entry.min);
+        if (present[i].exit_time >= 0) {
+            timestamp_t exit = minute_to_timestamp(present[i].exit_time);
+            printf(" %02d-%02d-%4d %02d:%02d", exit.d, exit.mth, exit.y,
+             exit.h, exit.min);
+        }
+        printf("\n");
+    }
+    safe_free(present);
+}
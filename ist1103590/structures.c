@@ -32,8 +32,9 @@ list_t* init_list() {
 /**
  * Inserts a given (already allocated) value into the 
  * given double linked list, as the last element.
+ * Returns the new node so callers can keep a handle to it.
  */
-void insert_list(list_t* list, void* elem) {
+node_t* insert_list(list_t* list, void* elem) {
     node_t* node = (node_t*)safe_malloc(sizeof(node_t));
 
     node->val = elem;
@@ -47,6 +48,7 @@ void insert_list(list_t* list, void* elem) {
         list->tail->next = node;
     }
     list->tail = node;
+    return node;
 }
 
 
@@ -149,11 +151,11 @@ void delete_list(list_t* list) {
         node_t* aux = next;
         next = aux->next;
         
-        free(aux->val);
-        free(aux);
+        safe_free(aux->val);
+        safe_free(aux);
     }
 
-    free(list);
+    safe_free(list);
 }
 
 /**
@@ -167,35 +169,282 @@ void delete_node(list_t* list, void* val) {
     }
 
     if(curr != NULL) {
-        if(curr->prev != NULL) {
-            curr->prev->next = curr->next;
-        } else {
-            list->head = curr->next;
-        }
-        if(curr->next != NULL) {
-            curr->next->prev = curr->prev;
-        } else {
-            list->tail = curr->prev;
+        unlink_node(list, curr);
+    }
+}
+
+/**
+ * Unlinks a node whose address is already known from the list
+ * and frees it, in constant time.
+ */
+void unlink_node(list_t* list, node_t* node) {
+    if(node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        list->head = node->next;
+    }
+    if(node->next != NULL) {
+        node->next->prev = node->prev;
+    } else {
+        list->tail = node->prev;
+    }
+    safe_free(node);
+}
+
+/* Skiplist */
+
+/**
+ * Creates a new empty skiplist.
+*/
+skiplist_t* init_skiplist() {
+    skiplist_t* sl = (skiplist_t*)safe_malloc(sizeof(skiplist_t));
+    sl->head = (skip_node_t*)safe_malloc(sizeof(skip_node_t));
+    sl->head->key = NULL;
+    sl->head->val = NULL;
+    sl->head->level = SKIPLIST_MAX_LEVEL;
+    for (int i = 0; i < SKIPLIST_MAX_LEVEL; i++) {
+        sl->head->next[i] = NULL;
+    }
+    sl->level = 1;
+    sl->seed = 2463534242u;
+    return sl;
+}
+
+/**
+ * Draws the level of a new node, each level being
+ * half as likely as the one below it.
+*/
+int skiplist_random_level(skiplist_t* sl) {
+    int level = 1;
+    sl->seed ^= sl->seed << 13;
+    sl->seed ^= sl->seed >> 17;
+    sl->seed ^= sl->seed << 5;
+    unsigned bits = sl->seed;
+    while ((bits & 1) && level < SKIPLIST_MAX_LEVEL) {
+        level++;
+        bits >>= 1;
+    }
+    return level;
+}
+
+/**
+ * Fills update with the last node before the given key
+ * at every level of the skiplist.
+*/
+void skiplist_find(skiplist_t* sl, const char* key,
+                     skip_node_t* update[]) {
+    skip_node_t* current = sl->head;
+    for (int i = sl->level - 1; i >= 0; i--) {
+        while (current->next[i] && strcmp(current->next[i]->key, key) < 0) {
+            current = current->next[i];
         }
-        free(curr);
+        update[i] = current;
+    }
+}
+
+/**
+ * Inserts a value with the given key (which is not copied)
+ * into the skiplist.
+*/
+void skiplist_insert(skiplist_t* sl, char* key, void* val) {
+    skip_node_t* update[SKIPLIST_MAX_LEVEL];
+    skiplist_find(sl, key, update);
+
+    int level = skiplist_random_level(sl);
+    for (int i = sl->level; i < level; i++) {
+        update[i] = sl->head;
+    }
+    if (level > sl->level) sl->level = level;
+
+    skip_node_t* node = (skip_node_t*)safe_malloc(sizeof(skip_node_t));
+    node->key = key;
+    node->val = val;
+    node->level = level;
+    for (int i = 0; i < level; i++) {
+        node->next[i] = update[i]->next[i];
+        update[i]->next[i] = node;
+    }
+}
+
+/**
+ * Removes the node with the given key from the skiplist,
+ * freeing the node but not its value.
+*/
+void skiplist_delete(skiplist_t* sl, const char* key) {
+    skip_node_t* update[SKIPLIST_MAX_LEVEL];
+    skiplist_find(sl, key, update);
+
+    skip_node_t* node = update[0]->next[0];
+    if (!node || strcmp(node->key, key)) return;
+    for (int i = 0; i < node->level; i++) {
+        update[i]->next[i] = node->next[i];
+    }
+    while (sl->level > 1 && !sl->head->next[sl->level - 1]) {
+        sl->level--;
+    }
+    safe_free(node);
+}
+
+/**
+ * Returns the first node with a key not smaller than the given one,
+ * or the first node of the skiplist if key is NULL.
+*/
+skip_node_t* skiplist_lower_bound(skiplist_t* sl, const char* key) {
+    skip_node_t* update[SKIPLIST_MAX_LEVEL];
+    if (!key) return sl->head->next[0];
+    skiplist_find(sl, key, update);
+    return update[0]->next[0];
+}
+
+/**
+ * Frees the skiplist nodes and their values.
+*/
+void delete_skiplist(skiplist_t* sl) {
+    skip_node_t* current = sl->head->next[0];
+    while (current) {
+        skip_node_t* next = current->next[0];
+        safe_free(current->val);
+        safe_free(current);
+        current = next;
+    }
+    safe_free(sl->head);
+    safe_free(sl);
+}
+
+/* Fenwick tree */
+
+/**
+ * Creates a new fenwick tree with every bucket set to zero.
+*/
+fenwick_t* init_fenwick() {
+    fenwick_t* ft = (fenwick_t*)safe_malloc(sizeof(fenwick_t));
+    ft->size = FENWICK_INIT_SIZE;
+    ft->tree = (long long*)safe_malloc((ft->size + 1) * sizeof(long long));
+    memset(ft->tree, 0, (ft->size + 1) * sizeof(long long));
+    return ft;
+}
+
+/**
+ * Doubles the number of buckets of the tree.
+ * Since the size is a power of two, the new upper half is empty
+ * except for its last node, which covers the whole old range.
+*/
+void grow_fenwick(fenwick_t* ft) {
+    int old_size = ft->size;
+    long long* tree = (long long*)safe_malloc((2 * old_size + 1) *
+     sizeof(long long));
+    memcpy(tree, ft->tree, (old_size + 1) * sizeof(long long));
+    memset(tree + old_size + 1, 0, old_size * sizeof(long long));
+    tree[2 * old_size] = ft->tree[old_size];
+    safe_free(ft->tree);
+    ft->tree = tree;
+    ft->size = 2 * old_size;
+}
+
+/**
+ * Adds a value to the bucket with the given (0 based) index,
+ * growing the tree if the index is past its end.
+*/
+void fenwick_add(fenwick_t* ft, int idx, long long value) {
+    while (idx >= ft->size) {
+        grow_fenwick(ft);
+    }
+    for (idx++; idx <= ft->size; idx += idx & -idx) {
+        ft->tree[idx] += value;
+    }
+}
+
+/**
+ * Returns the sum of the buckets from 0 up to idx (inclusive).
+*/
+long long fenwick_prefix(fenwick_t* ft, int idx) {
+    long long sum = 0;
+    if (idx >= ft->size) idx = ft->size - 1;
+    for (idx++; idx > 0; idx -= idx & -idx) {
+        sum += ft->tree[idx];
+    }
+    return sum;
+}
+
+/**
+ * Returns the sum of the buckets from lo to hi (inclusive).
+*/
+long long fenwick_range(fenwick_t* ft, int lo, int hi) {
+    if (hi < lo) return 0;
+    return fenwick_prefix(ft, hi) - (lo > 0 ? fenwick_prefix(ft, lo - 1) : 0);
+}
+
+/**
+ * Frees the fenwick tree and its buckets.
+*/
+void free_fenwick(fenwick_t* ft) {
+    safe_free(ft->tree);
+    safe_free(ft);
+}
+
+/* Daily buckets */
+
+/**
+ * Creates an array of daily buckets of the given size in bytes,
+ * with no days yet.
+*/
+daily_t* init_daily(int bucket_bytes) {
+    daily_t* daily = (daily_t*)safe_malloc(sizeof(daily_t));
+    daily->bucket_bytes = bucket_bytes;
+    daily->size = DAILY_INIT_DAYS;
+    daily->days = (void**)safe_malloc(daily->size * sizeof(void*));
+    memset(daily->days, 0, daily->size * sizeof(void*));
+    return daily;
+}
+
+/**
+ * Frees the daily buckets and their array.
+*/
+void free_daily(daily_t* daily) {
+    for (int day = 0; day < daily->size; day++) {
+        safe_free(daily->days[day]);
+    }
+    safe_free(daily->days);
+    safe_free(daily);
+}
+
+/**
+ * Returns the bucket of a day, growing the array if the day
+ * is past its end and creating the bucket, zeroed, on first use.
+*/
+void* daily_bucket(daily_t* daily, int day) {
+    int scope = mem_scope(MEM_PARKS);
+    if (day >= daily->size) {
+        int size = daily->size;
+        while (day >= size) size *= 2;
+        daily->days = (void**)safe_realloc(daily->days,
+         size * sizeof(void*));
+        memset(daily->days + daily->size, 0,
+         (size - daily->size) * sizeof(void*));
+        daily->size = size;
+    }
+    if (!daily->days[day]) {
+        daily->days[day] = safe_malloc(daily->bucket_bytes);
+        memset(daily->days[day], 0, daily->bucket_bytes);
     }
+    mem_scope(scope);
+    return daily->days[day];
 }
 
 /* Hash table */
 
 /**
- * Calculates the hash value for a given vehicle license plate.
- * Sums the ascii values of the license plate using that sum
- * to ensure the hash value fits within the bounds of the
- * hashtable array.
+ * Calculates the hash value for a given vehicle license plate
+ * (FNV-1a), spreading similar plates over the whole range so
+ * the low bits can be used as the bucket index.
 */
-int hash(char* plate) {
-    int sum = 0;
-    int len = strlen(plate);
-    for (int i = 0; i < len; i++) {
-        sum += plate[i];
+unsigned int hash(char* plate) {
+    unsigned int h = 2166136261u;
+    for (; *plate; plate++) {
+        h ^= (unsigned char)*plate;
+        h *= 16777619u;
     }
-    return sum % HASH_TABLE_SIZE;
+    return h;
 }
 
 /**
@@ -204,23 +453,74 @@ int hash(char* plate) {
 */
 hash_table* init_ht() {
     hash_table* hashtable = (hash_table*)safe_malloc(sizeof(hash_table));
+    hashtable->size = HASH_TABLE_SIZE;
+    hashtable->count = 0;
+    hashtable->table = (node_h**)safe_malloc(
+        HASH_TABLE_SIZE * sizeof(node_h*));
     for (int i = 0; i < HASH_TABLE_SIZE; i++) {
         hashtable->table[i] = NULL;
     }
     return hashtable;
 }
 
+/**
+ * Doubles the number of buckets of the hash table, moving every
+ * node to its new bucket using the hash it already stores.
+*/
+void grow_ht(hash_table* hashtable) {
+    int size = hashtable->size * 2;
+    node_h** table = (node_h**)safe_malloc(size * sizeof(node_h*));
+    for (int i = 0; i < size; i++) {
+        table[i] = NULL;
+    }
+    for (int i = 0; i < hashtable->size; i++) {
+        node_h* current = hashtable->table[i];
+        while (current != NULL) {
+            node_h* next = current->next;
+            int index = current->hash & (size - 1);
+            current->next = table[index];
+            table[index] = current;
+            current = next;
+        }
+    }
+    safe_free(hashtable->table);
+    hashtable->table = table;
+    hashtable->size = size;
+}
+
 /**
  * Inserts a vehicle into the hash table.
  * Calculates the hash value for the vehicle's license plate
- * to determine the appropriate slot in the hash table.
+ * to determine the appropriate slot in the hash table, growing
+ * the table first so chains stay about one node long.
 */
 void insert_ht(hash_table* hashtable, vehicle_t* vhc) {
-    int index = hash(vhc->license_plate);
+    if (hashtable->count == hashtable->size) {
+        grow_ht(hashtable);
+    }
+    unsigned int h = hash(vhc->license_plate);
+    int index = h & (hashtable->size - 1);
     node_h* newNode = (node_h*)safe_malloc(sizeof(node_h));
     newNode->vehicle = vhc;
+    newNode->hash = h;
     newNode->next = hashtable->table[index];
     hashtable->table[index] = newNode;
+    hashtable->count++;
+}
+
+/**
+ * Traverses a chain of the hash table from the given node,
+ * looking for a vehicle with a matching license plate.
+*/
+vehicle_t* search_chain(node_h* current, unsigned int h, char* plate) {
+    while (current != NULL) {
+        if (current->hash == h &&
+            !strcmp(current->vehicle->license_plate, plate)) {
+            return current->vehicle;
+        }
+        current = current->next;
+    }
+    return NULL;
 }
 
 /**
@@ -230,13 +530,48 @@ void insert_ht(hash_table* hashtable, vehicle_t* vhc) {
  * at that slot to find a vehicle witha  matching license plate.
 */
 vehicle_t* search_ht(hash_table* hashtable, char* plate) {
-    int index = hash(plate);
-    node_h* current = hashtable->table[index];
-    while (current != NULL) {
-        if (!strcmp(current->vehicle->license_plate, plate)) {
-            return current->vehicle;
+    unsigned int h = hash(plate);
+    return search_chain(hashtable->table[h & (hashtable->size - 1)],
+     h, plate);
+}
+
+/**
+ * Searches for n license plates at once, storing each vehicle
+ * found (or NULL) in found.
+ * Every lookup is a chain of dependent loads (bucket, node,
+ * vehicle), so the plates are taken HT_BATCH at a time and each
+ * step is done for the whole group before the next one, with a
+ * prefetch of what the following step reads. The misses of the
+ * group then overlap instead of being paid one after the other.
+*/
+void search_ht_batch(hash_table* hashtable, char** plates, int n,
+                      vehicle_t** found) {
+    unsigned int hashes[HT_BATCH];
+    node_h* nodes[HT_BATCH];
+    int mask = hashtable->size - 1;
+
+    for (int base = 0; base < n; base += HT_BATCH) {
+        int size = n - base < HT_BATCH ? n - base : HT_BATCH;
+        char** group = plates + base;
+
+        for (int j = 0; j < size; j++) {
+            hashes[j] = hash(group[j]);
+            PREFETCH(&hashtable->table[hashes[j] & mask]);
+        }
+        for (int j = 0; j < size; j++) {
+            nodes[j] = hashtable->table[hashes[j] & mask];
+            if (nodes[j]) PREFETCH(nodes[j]);
+        }
+        for (int j = 0; j < size; j++) {
+            node_h* current = nodes[j];
+            while (current && current->hash != hashes[j]) {
+                current = current->next;
+            }
+            nodes[j] = current;
+            if (current) PREFETCH(current->vehicle);
+        }
+        for (int j = 0; j < size; j++) {
+            found[base + j] = search_chain(nodes[j], hashes[j], group[j]);
         }
-        current = current->next;
     }
-    return NULL;
 }
@@ -17,17 +17,34 @@
 
 /**
  * Creates a new vehicle initializing its values correctly
- * and inserts it into the system's vehicle hash table.
+ * and inserts it into the system's vehicle hash table,
+ * giving it the next free vehicle id.
  * Returns the newly created vehicle.
 */
 vehicle_t* add_vehicle(char* license_plate, entry_t* entry,
      timestamp_t entry_d, system_t* sys) {
+    int scope = mem_scope(MEM_VEHICLES);
     vehicle_t* new_vehicle = (vehicle_t*)safe_malloc(sizeof(vehicle_t));
     new_vehicle->last_entry = entry_d;
     new_vehicle->current_entry = entry;
+    new_vehicle->park_node = NULL;
+    new_vehicle->total_cents = 0;
+    new_vehicle->total_visits = 0;
+    new_vehicle->park_stats = NULL;
+    new_vehicle->version = 0;
+    new_vehicle->alert = NULL;
+
+    if (sys->num_vehicles == sys->vehicle_ids_capacity) {
+        sys->vehicle_ids_capacity *= 2;
+        sys->vehicle_ids = (vehicle_t**)safe_realloc(sys->vehicle_ids,
+         sys->vehicle_ids_capacity * sizeof(vehicle_t*));
+    }
+    new_vehicle->id = sys->num_vehicles;
+    sys->vehicle_ids[sys->num_vehicles++] = new_vehicle;
 
     strcpy(new_vehicle->license_plate, license_plate);
     insert_ht(sys->vhc_ht, new_vehicle);
+    mem_scope(scope);
     return new_vehicle;
     
 }
@@ -91,15 +108,27 @@ int invalid_vehicle_args(char* license_plate) {
  * recorded in the system, which are sorted
  * firstly by the park name
  * and subsequently by the entry date and time.
+ * Only the parks the vehicle has been to are visited,
+ * ordered through the system's park rank table.
 */
 void vehicle_activity_logs(char* license_plate, system_t* sys) {
-    int count = 0;
+    int count = 0, num_ids = 0, ids[MAX_P];
+    vehicle_t* vhc = search_ht(sys->vhc_ht, license_plate);
     
-    node_t* park_node = sys->srtd_parks->head;
-    while (park_node) {
-        park_t* park = (park_t*)park_node->val;
-        count += log_vehicle_activities_in_park(license_plate, park);
-        park_node = park_node->next;
+    if (vhc) {
+        vehicle_stats_t* stats = vhc->park_stats;
+        for (; stats; stats = stats->next) {
+            ids[num_ids++] = stats->park->id;
+        }
+        if (vhc->current_entry && !get_vehicle_stats_if_any(vhc,
+             sys->park_ids[vhc->current_entry->park_id])) {
+            ids[num_ids++] = vhc->current_entry->park_id;
+        }
+    }
+    sort_by_park_rank(ids, num_ids, sys);
+    for (int i = 0; i < num_ids; i++) {
+        count += log_vehicle_activities_and_aged(vhc,
+         sys->park_ids[ids[i]], sys);
     }
 
     // No entries found
@@ -116,7 +145,7 @@ int log_vehicle_activities_in_park(char* license_plate, park_t* park) {
         entry_t* entry = (entry_t*)entry_node->val;
         if (!strcmp(entry->vehicle->license_plate, license_plate)) {
             activity_count++;
-            print_entries(entry);
+            print_entries(entry, park);
             print_corresponding_exit_if_exists(license_plate, entry, park);
         }
         entry_node = entry_node->next;
@@ -125,6 +154,40 @@ int log_vehicle_activities_in_park(char* license_plate, park_t* park) {
 }
 
 
+/**
+ * Lists the activity of a vehicle in a park and warns about
+ * its stays that were aged out of the park's history.
+ * Returns the number of printed lines.
+*/
+int log_vehicle_activities_and_aged(vehicle_t* vhc, park_t* park,
+                                      system_t* sys) {
+    int count, listed, aged;
+
+    if (park->history)
+        count = log_vehicle_history_in_park(vhc, park, sys);
+    else {
+        count = log_vehicle_activities_in_park(vhc->license_plate, park);
+        if (vhc->current_entry && vhc->current_entry->open_node &&
+            vhc->current_entry->park_id == park->id) {
+            print_entries(vhc->current_entry, park);
+            printf("\n");
+            count++;
+        }
+    }
+
+    listed = count;
+    if (vhc->current_entry &&
+        vhc->current_entry->park_id == park->id)
+        listed--;
+    aged = aged_out_stays(vhc, park, listed);
+    if (aged > 0) {
+        printf(VEHICLE_AGED_OUT, park->park_name, aged);
+        count++;
+    }
+    return count;
+}
+
+
 void print_corresponding_exit_if_exists(char* license_plate, entry_t* entry, park_t* park) {
     node_t* exit_node = park->park_exits->head;
     while(exit_node) {
@@ -143,9 +206,9 @@ void print_corresponding_exit_if_exists(char* license_plate, entry_t* entry, par
 /**
  * Prints vehicle sorted entries.
 */
-void print_entries(entry_t* entry) {
+void print_entries(entry_t* entry, park_t* park) {
     printf("%s %02d-%02d-%4d %02d:%02d", 
-        entry->park_name,
+        park->park_name,
         entry->entry_date_time.d, 
         entry->entry_date_time.mth,
         entry->entry_date_time.y, 
@@ -163,4 +226,19 @@ void print_corresponding_exits(exit_t* corresponding_exit) {
         corresponding_exit->exit_date_time.y,
         corresponding_exit->exit_date_time.h,
         corresponding_exit->exit_date_time.min);
-}
\ No newline at end of file
+}
+
+/**
+ * Sorts park ids by the name of their parks, using
+ * insertion sort since there are at most MAX_P of them.
+*/
+void sort_by_park_rank(int* ids, int num_ids, system_t* sys) {
+    for (int i = 1; i < num_ids; i++) {
+        int id = ids[i], j = i;
+        while (j > 0 && sys->park_rank[ids[j - 1]] > sys->park_rank[id]) {
+            ids[j] = ids[j - 1];
+            j--;
+        }
+        ids[j] = id;
+    }
+}
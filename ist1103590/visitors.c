@@ -0,0 +1,195 @@
+/**
+ * @file visitors.c
+ *
+ * @author Tiago Firmino - ist1103590
+ *
+ * File containing functions used to estimate how many distinct
+ * vehicles entered a park, or every park, over a range of days.
+ * Each park keeps a hyperloglog sketch of the license plates
+ * of the entries of each day, a fixed number of small registers
+ * no matter how much traffic it sees. Sketches are merged by
+ * taking the largest value of each register, so any range of days
+ * and any set of parks is answered from the sketches alone, with
+ * a standard error of about 1.04 / sqrt(HLL_REGISTERS).
+ *
+*/
+
+#include "project.h"
+#include "prototypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/**
+ * Creates a new empty sketch.
+*/
+hll_t* init_hll() {
+    hll_t* hll = (hll_t*)safe_malloc(sizeof(hll_t));
+    memset(hll->registers, 0, HLL_REGISTERS);
+    return hll;
+}
+
+/**
+ * Hashes a license plate into 64 well mixed bits
+ * (64 bit FNV-1a followed by the murmur3 finalizer).
+*/
+unsigned long long hll_hash(char* plate) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (; *plate; plate++) {
+        h ^= (unsigned char)*plate;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * Adds a license plate to a sketch. The first bits of its hash
+ * pick a register, which keeps the longest run of leading zeros
+ * (plus one) seen in the remaining bits.
+*/
+void hll_add(hll_t* hll, char* plate) {
+    unsigned long long h = hll_hash(plate);
+    int index = (int)(h >> (64 - HLL_PRECISION));
+    unsigned long long rest = h << HLL_PRECISION;
+    int rank = 1;
+
+    while (rank <= 64 - HLL_PRECISION && !(rest & (1ULL << 63))) {
+        rest <<= 1;
+        rank++;
+    }
+    if (rank > hll->registers[index])
+        hll->registers[index] = (unsigned char)rank;
+}
+
+/**
+ * Merges a sketch into another, which then counts both.
+*/
+void hll_merge(hll_t* into, hll_t* from) {
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        if (from->registers[i] > into->registers[i])
+            into->registers[i] = from->registers[i];
+    }
+}
+
+/**
+ * Natural logarithm of a positive number, since the
+ * math library is not linked: the number is reduced to [1, 2)
+ * by powers of two, then ln(f) = 2 atanh((f - 1) / (f + 1)).
+*/
+double natural_log(double x) {
+    const double ln2 = 0.69314718055994530942;
+    double result = 0, term, y, y2;
+    int k = 0;
+
+    while (x >= 2) {
+        x /= 2;
+        k++;
+    }
+    while (x < 1) {
+        x *= 2;
+        k--;
+    }
+    y = (x - 1) / (x + 1);
+    y2 = y * y;
+    term = y;
+    for (int n = 1; n < 40; n += 2) {
+        result += term / n;
+        term *= y2;
+    }
+    return k * ln2 + 2 * result;
+}
+
+/**
+ * Returns the estimated number of distinct license plates added
+ * to a sketch, using linear counting while many registers are
+ * still empty, where it is more accurate.
+*/
+long long hll_estimate(hll_t* hll) {
+    double m = HLL_REGISTERS, sum = 0, estimate;
+    int zeros = 0;
+
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        sum += 1.0 / (double)(1ULL << hll->registers[i]);
+        if (!hll->registers[i]) zeros++;
+    }
+    estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros)
+        estimate = m * natural_log(m / zeros);
+    return (long long)(estimate + 0.5);
+}
+
+/**
+ * Prints the registers of a sketch in hexadecimal, on one line.
+*/
+void print_hll(hll_t* hll) {
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        printf("%02x", hll->registers[i]);
+    }
+    printf("\n");
+}
+
+/**
+ * Reads the registers of a sketch printed by print_hll.
+ * Returns FALSE if the line is not a sketch.
+*/
+int read_hll(hll_t* hll, char* line) {
+    unsigned value;
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        if (!isxdigit(line[2 * i]) || !isxdigit(line[2 * i + 1]) ||
+            sscanf(line + 2 * i, "%2x", &value) != 1)
+            return FALSE;
+        hll->registers[i] = (unsigned char)value;
+    }
+    return line[2 * HLL_REGISTERS] == '\n';
+}
+
+/**
+ * Counts the vehicle of an entry in the sketch of its day.
+*/
+void count_visitor(daily_t* visitors, int day, char* plate) {
+    hll_add((hll_t*)daily_bucket(visitors, day), plate);
+}
+
+/**
+ * Merges the sketches of a park between two days (both inclusive).
+*/
+void merge_visitors(hll_t* into, daily_t* visitors, int from_day,
+                      int to_day) {
+    for (int day = from_day; day <= to_day && day < visitors->size; day++) {
+        if (visitors->days[day])
+            hll_merge(into, (hll_t*)visitors->days[day]);
+    }
+}
+
+/**
+ * Shows the estimated number of distinct vehicles that entered
+ * the given park, or any park if none is given, between two dates
+ * (both inclusive). In router mode the workers print the merged
+ * sketch instead, for the router to merge theirs.
+*/
+void print_distinct_vehicles(park_t* park, timestamp_t from,
+                               timestamp_t to, system_t* sys) {
+    hll_t* merged = init_hll();
+    int from_day = get_day_index(from), to_day = get_day_index(to);
+
+    if (park) {
+        merge_visitors(merged, park->visitors, from_day, to_day);
+    } else {
+        node_t* current = sys->parks->head;
+        for (; current != NULL; current = current->next) {
+            merge_visitors(merged, ((park_t*)current->val)->visitors,
+             from_day, to_day);
+        }
+    }
+    if (sys->raw_sketches)
+        print_hll(merged);
+    else
+        printf("%lld\n", hll_estimate(merged));
+    safe_free(merged);
+}